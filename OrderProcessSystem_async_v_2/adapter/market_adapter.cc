@@ -0,0 +1,159 @@
+#ifndef MARKET_ADAPTER_CC
+#define MARKET_ADAPTER_CC
+#include "market_adapter.h"
+
+static_assert(EXEC_REPLACE_REJECT==(int)ExecutionReport::REPLACE_REJECT, "ExecStatus should match ExecutionReport::STAT");
+static_assert(FILTER_BUY==(int)MassCancelRequest::BUY&&FILTER_BUY==(int)QueryOrderRequest::BUY, "SideFilter should match the request enums");
+
+// 非法的方向和类型取值, 由撮合核心拒绝
+static const uint8_t INVALID_ENUM=0xff;
+
+void toNewOrder(const NewOrderRequest& request, NewOrder& order){
+	order.clientID=request.clientid();
+	if(request.direction()==NewOrderRequest::SELL) order.side=SIDE_SELL;
+	else if(request.direction()==NewOrderRequest::BUY) order.side=SIDE_BUY;
+	else order.side=(OrderSide)INVALID_ENUM;
+	if(request.ordertype()==NewOrderRequest::LIMIT) order.kind=KIND_LIMIT;
+	else if(request.ordertype()==NewOrderRequest::MARKET) order.kind=KIND_MARKET;
+	else order.kind=(OrderKind)INVALID_ENUM;
+	order.stockID=request.stockid();
+	order.orderQty=request.orderqty();
+	order.price=request.price();
+	order.priceTicks=request.priceticks();
+	order.clOrdID=request.clordid();
+}
+
+void toAmendOrder(const AmendOrderRequest& request, AmendOrder& amend){
+	amend.orderID=request.orderid();
+	amend.orderQty=request.orderqty();
+	amend.price=request.price();
+	amend.priceTicks=request.priceticks();
+}
+
+// 未知的方向保持非法: 批量撤单不撤任何订单, 查询不过滤
+static SideFilter toSideFilter(const int& side){
+	return side>=FILTER_BOTH&&side<=FILTER_BUY ? (SideFilter)side: (SideFilter)INVALID_ENUM;
+}
+
+void toMassCancel(const MassCancelRequest& request, MassCancel& cancel){
+	cancel.clientID=request.clientid();
+	cancel.stockID=request.stockid();
+	cancel.side=toSideFilter(request.side());
+}
+
+void toOrderQuery(const QueryOrderRequest& request, OrderQuery& query){
+	query.clientID=request.clientid();
+	query.stockID=request.stockid();
+	query.side=toSideFilter(request.side());
+	query.minOrderID=request.minorderid();
+	query.maxOrderID=request.maxorderid();
+	query.pageSize=request.pagesize();
+	query.cursor=request.cursor();
+}
+
+// 时间为0时不填
+static std::string toTime(const int64_t& time){
+	return time>0 ? getTime(time): "";
+}
+
+void toReport(const Execution& exec, ExecutionReport& report){
+	report.set_stat((ExecutionReport::STAT)exec.stat);
+	report.set_clientid(exec.clientID);
+	report.set_orderid(exec.orderID);
+	report.set_clordid(exec.clOrdID);
+	report.set_stockid(exec.stockID);
+	report.set_orderqty(exec.orderQty);
+	report.set_orderprice(exec.orderPrice);
+	report.set_orderpriceticks(exec.orderPriceTicks);
+	report.set_fillqty(exec.fillQty);
+	report.set_fillprice(exec.fillPrice);
+	report.set_fillpriceticks(exec.fillPriceTicks);
+	report.set_leaveqty(exec.leaveQty);
+	report.set_errormessage(exec.error!=nullptr ? exec.error: "");
+	report.set_time(toTime(exec.time));
+}
+
+void toReport(const MassCancelResult& result, MassCancelReport& report){
+	report.set_clientid(result.clientID);
+	report.set_canceledorders(result.canceledOrders);
+	report.set_canceledqty(result.canceledQty);
+	report.clear_orderids();
+	for(auto orderID:result.orderIDs) report.add_orderids(orderID);
+	report.set_errormessage(result.error!=nullptr ? result.error: "");
+	report.set_time(toTime(result.time));
+}
+
+void toReport(const OrderInfo& order, OrderReport& report){
+	report.set_orderid(order.orderID);
+	report.set_clientid(order.clientID);
+	report.set_direction(order.side==SIDE_SELL ? OrderReport::SELL: OrderReport::BUY);
+	report.set_ordertype(order.kind==KIND_LIMIT ? OrderReport::LIMIT: OrderReport::MARKET);
+	report.set_stockid(order.stockID);
+	report.set_orderqty(order.orderQty);
+	report.set_price(order.price);
+	report.set_priceticks(order.priceTicks);
+	report.set_time(toTime(order.time));
+	report.set_version(order.version);
+}
+
+// 撮合核心的应答, 每个线程复用一份
+static thread_local std::vector<std::pair<SessionID, Execution> > executions;
+
+// 把撮合核心的应答转换后追加到reports
+static void appendReports(std::vector<std::pair<SessionID, ExecutionReport> >& reports){
+	for(auto& exec:executions){
+		reports.emplace_back();
+		reports.back().first=exec.first;
+		toReport(exec.second, reports.back().second);
+	}
+}
+
+void processNewOrder(TradingMarket& market, const NewOrderRequest& request, const SessionID& session,
+		std::vector<std::pair<SessionID, ExecutionReport> >& reports, uint64_t& orderID){
+	NewOrder order;
+	toNewOrder(request, order);
+	executions.clear();
+	market.processNewOrder(order, session, executions, orderID);
+	appendReports(reports);
+}
+
+void processCancelOrder(TradingMarket& market, const CancelOrderRequest& request, ExecutionReport& report, SessionID& session){
+	Execution exec;
+	market.processCancelOrder(request.orderid(), exec, session);
+	toReport(exec, report);
+}
+
+void processAmendOrder(TradingMarket& market, const AmendOrderRequest& request, std::vector<std::pair<SessionID, ExecutionReport> >& reports){
+	AmendOrder amend;
+	toAmendOrder(request, amend);
+	executions.clear();
+	market.processAmendOrder(amend, executions);
+	appendReports(reports);
+}
+
+void processMassCancel(TradingMarket& market, const MassCancelRequest& request, MassCancelReport& report){
+	MassCancel cancel;
+	MassCancelResult result;
+	toMassCancel(request, cancel);
+	market.processMassCancel(cancel, result);
+	toReport(result, report);
+}
+
+void cancelSessionOrders(TradingMarket& market, const SessionID& session, const std::set<uint64_t>& clientIDs, MassCancelReport& report){
+	MassCancelResult result;
+	market.cancelSessionOrders(session, clientIDs, result);
+	toReport(result, report);
+}
+
+void processQueryOrder(TradingMarket& market, const QueryOrderRequest& request, std::vector<OrderReport>& reports){
+	OrderQuery query;
+	std::vector<OrderInfo> orders;
+	toOrderQuery(request, query);
+	market.processQueryOrder(query, orders);
+	reports.reserve(reports.size()+orders.size());
+	for(auto& order:orders){
+		reports.emplace_back();
+		toReport(order, reports.back());
+	}
+}
+#endif
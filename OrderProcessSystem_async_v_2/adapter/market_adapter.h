@@ -0,0 +1,32 @@
+#ifndef MARKET_ADAPTER_H
+#define MARKET_ADAPTER_H
+
+#include <set>
+#include <vector>
+#include <utility>
+#include "../market/market.h"
+#include "../helper/helper.h"
+
+using OPS::QueryOrderRequest;
+
+// 适配层：在protobuf消息与撮合核心的结构体之间转换, 撮合核心本身不依赖gRPC和protobuf
+
+// 请求: protobuf -> 撮合核心
+void toNewOrder(const NewOrderRequest&, NewOrder&);
+void toAmendOrder(const AmendOrderRequest&, AmendOrder&);
+void toMassCancel(const MassCancelRequest&, MassCancel&);
+void toOrderQuery(const QueryOrderRequest&, OrderQuery&);
+// 应答: 撮合核心 -> protobuf
+void toReport(const Execution&, ExecutionReport&);
+void toReport(const MassCancelResult&, MassCancelReport&);
+void toReport(const OrderInfo&, OrderReport&);
+
+// 以protobuf消息调用撮合核心, 参数与返回值的含义同TradingMarket中的同名接口
+void processNewOrder(TradingMarket&, const NewOrderRequest&, const SessionID&, std::vector<std::pair<SessionID, ExecutionReport> >&, uint64_t&);
+void processCancelOrder(TradingMarket&, const CancelOrderRequest&, ExecutionReport&, SessionID&);
+void processAmendOrder(TradingMarket&, const AmendOrderRequest&, std::vector<std::pair<SessionID, ExecutionReport> >&);
+void processMassCancel(TradingMarket&, const MassCancelRequest&, MassCancelReport&);
+void cancelSessionOrders(TradingMarket&, const SessionID&, const std::set<uint64_t>&, MassCancelReport&);
+void processQueryOrder(TradingMarket&, const QueryOrderRequest&, std::vector<OrderReport>&);
+
+#endif
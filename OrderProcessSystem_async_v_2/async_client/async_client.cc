@@ -27,9 +27,33 @@ CancelOrderRequest MakeCancelOrderRequest(const uint64_t& orderID){
 	return request;
 }
 
+// 创建改单请求
+AmendOrderRequest MakeAmendOrderRequest(const uint64_t& orderID, const uint32_t& orderQty, const double& price){
+	AmendOrderRequest request;
+	request.set_orderid(orderID);
+	request.set_orderqty(orderQty);
+	request.set_price(price);
+	request.set_time(getTime());
+	return request;
+}
+
+// 创建批量撤单请求
+MassCancelRequest MakeMassCancelRequest(const uint64_t& clientID, const std::string& stockID, const std::string& side){
+	MassCancelRequest request;
+	request.set_clientid(clientID);
+	if(stockID!="*") request.set_stockid(stockID);
+	if(side=="SELL") request.set_side(MassCancelRequest::SELL);
+	else if(side=="BUY") request.set_side(MassCancelRequest::BUY);
+	else request.set_side(MassCancelRequest::BOTH);
+	request.set_time(getTime());
+	return request;
+}
+
 // 创建查询订单请求
-QueryOrderRequest MakeQueryOrderRequest(){
+QueryOrderRequest MakeQueryOrderRequest(const uint64_t& cursor){
 	QueryOrderRequest request;
+	request.set_pagesize(QUERY_PAGE_SIZE);
+	request.set_cursor(cursor);
 	request.set_time(getTime());
 	return request;
 }
@@ -53,70 +77,170 @@ void readNewOrderRequest(const std::string& fileName, std::vector<NewOrderReques
 	}
 }
 
-// 撤销订单类
-AsyncClientCallPushCancelOrder::AsyncClientCallPushCancelOrder(const CancelOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
+// 报单流类
+AsyncClientCallOrderEntry::AsyncClientCallOrderEntry(CompletionQueue& cq, std::unique_ptr<OrderService::Stub>& stub):
+	cq_(cq), stub_(stub), readTag_(this, &AsyncClientCallOrderEntry::OnRead),
+	writeTag_(this, &AsyncClientCallOrderEntry::OnWrite), finishTag_(this, &AsyncClientCallOrderEntry::OnFinish),
+	alarmTag_(this, &AsyncClientCallOrderEntry::OnAlarm), loggedOn_(false), writing_(false), readDone_(false),
+	token_(0), lastSeq_(0){
+	connect();
+}
+
+// 建立报单流
+void AsyncClientCallOrderEntry::connect(){
+	std::unique_lock<std::mutex> lk(mutex_);
+	context_.reset(new ClientContext);
+	responder_=stub_->PrepareAsyncOrderEntry(context_.get(), &cq_);
+	loggedOn_=false;
+	writing_=false;
+	readDone_=false;
+	responder_->StartCall((CompletionTag*)this);
+}
+
+// 流建立：单独一帧写出登录请求, 并开始读执行结果; 待发请求在收到登录应答后写出, 登录失败时不会丢失
+void AsyncClientCallOrderEntry::Proceed(bool ok){
+	{
+		std::unique_lock<std::mutex> lk(mutex_);
+		// 流建立失败时读操作会随即失败并结束流
+		if(ok){
+			writing_=true;
+			writing_batch_.Clear();
+			auto logon=writing_batch_.add_requests()->mutable_logon();
+			logon->set_sessiontoken(token_);
+			logon->set_lastseq(lastSeq_);
+			responder_->Write(writing_batch_, &writeTag_);
+		}
+	}
+	responder_->Read(&reportBatch_, &readTag_);
+}
+
+// 提交请求
+void AsyncClientCallOrderEntry::send(std::vector<OrderEntryRequest>&& requests){
+	std::unique_lock<std::mutex> lk(mutex_);
+	for(auto& request:requests){
+		pending_.push_back(std::move(request));
+	}
+	// 已登录且没有写操作在进行时由提交线程发起写操作, 否则由写完成或登录时写出
+	if(loggedOn_&&!writing_){
+		writing_=true;
+		WriteNext();
+	}
+}
+
+// 写出下一帧请求
+void AsyncClientCallOrderEntry::WriteNext(){
+	if(pending_.empty()){
+		writing_=false;
+		return;
+	}
+	// 上一帧写出期间提交的请求合并为一帧写出
+	writing_batch_.Clear();
+	while(!pending_.empty()&&writing_batch_.requests_size()<ORDER_ENTRY_BATCH_SIZE){
+		writing_batch_.add_requests()->Swap(&pending_.front());
+		pending_.pop_front();
+	}
+	responder_->Write(writing_batch_, &writeTag_);
+}
+
+// 写完成
+void AsyncClientCallOrderEntry::OnWrite(bool ok){
+	std::unique_lock<std::mutex> lk(mutex_);
+	if(!ok){
+		// 没有写出的一帧放回待发队列, 重连后重发; 新订单带客户订单ID, 服务端已处理过的会被去重
+		loggedOn_=false;
+		for(int i=writing_batch_.requests_size()-1;i>=0;i--){
+			if(writing_batch_.requests(i).has_logon()) continue;
+			pending_.emplace_front();
+			pending_.front().Swap(writing_batch_.mutable_requests(i));
+		}
+	}
+	if(!ok||readDone_||!loggedOn_){
+		writing_=false;
+		if(readDone_) finish();
+		return;
+	}
+	WriteNext();
+}
+
+// 结束流
+void AsyncClientCallOrderEntry::finish(){
+	responder_->Finish(&status_, &finishTag_);
+}
+
+// 读完成：打印一帧执行结果, 再读下一帧
+void AsyncClientCallOrderEntry::OnRead(bool ok){
+	if(!ok){
+		std::unique_lock<std::mutex> lk(mutex_);
+		readDone_=true;
+		loggedOn_=false;
+		// 有写操作在进行时取消调用, 写完成后再结束流
+		if(writing_) context_->TryCancel();
+		else finish();
+		return;
+	}
+	if(reportBatch_.has_logon()){
+		auto& logon=reportBatch_.logon();
+		if(token_!=0&&logon.nextseq()>lastSeq_+1){
+			std::cout<<"序号"<<lastSeq_+1<<"~"<<logon.nextseq()-1<<"的应答已被服务端覆盖, 请查询订单！"<<std::endl;
+		}
+		token_=logon.sessiontoken();
+		lastSeq_=logon.nextseq()-1;
+		std::cout<<"报单会话已登录, 会话令牌: "<<token_<<", 应答序号从"<<logon.nextseq()<<"开始"<<std::endl;
+		std::unique_lock<std::mutex> lk(mutex_);
+		loggedOn_=true;
+		if(!writing_){
+			writing_=true;
+			WriteNext();
+		}
+	}
+	for(auto& report:reportBatch_.reports()){
+		// 跳过已经收到过的应答
+		if(report.seq()>0&&report.seq()<=lastSeq_) continue;
+		if(report.seq()>0) lastSeq_=report.seq();
+		printReport(report);
+	}
+	reportBatch_.Clear();
+	responder_->Read(&reportBatch_, &readTag_);
+}
+
+// 结束完成：稍后重连
+void AsyncClientCallOrderEntry::OnFinish(bool ok){
+	std::cout<<"报单流已断开: "<<status_.error_message()<<", "<<RECONNECT_INTERVAL<<"秒后重连"<<std::endl;
+	if(status_.error_code()==grpc::StatusCode::NOT_FOUND){
+		// 会话已失效(例如服务端重启), 重连时建立新会话
+		std::cout<<"报单会话已失效, 将建立新会话, 请查询订单！"<<std::endl;
+		token_=0;
+		lastSeq_=0;
+	}
+	alarm_.Set(&cq_, std::chrono::system_clock::now()+std::chrono::seconds(RECONNECT_INTERVAL), &alarmTag_);
+}
+
+// 重连
+void AsyncClientCallOrderEntry::OnAlarm(bool ok){
+	connect();
+}
+
+// 批量撤单类
+AsyncClientCallMassCancel::AsyncClientCallMassCancel(const MassCancelRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
 	AbstractAsyncClientCall(){
-	// responder=stub_->AsyncPushCancelOrder(&context, request, &cq_);
-	responder=stub_->PrepareAsyncPushCancelOrder(&context, request, &cq_);
+	responder=stub_->PrepareAsyncMassCancel(&context, request, &cq_);
 	responder->StartCall();
-	responder->Finish(&report_, &status, (void*)this);
+	responder->Finish(&massCancelReport_, &status, (void*)this);
 	callStatus=PROCESS;
 }
 
-void AsyncClientCallPushCancelOrder::Proceed(bool ok){
+void AsyncClientCallMassCancel::Proceed(bool ok){
 		if(callStatus==PROCESS){
 			GPR_ASSERT(ok);
 			if(status.ok())
-				printReport(report_);
-			// TODO
+				printReport(massCancelReport_);
 			delete this;
 		}
 }
 
-// 提交订单类
-AsyncClientCallPushNewOrder::AsyncClientCallPushNewOrder(std::vector<NewOrderRequest>&& requests, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
-	AbstractAsyncClientCall(), requests_(requests), counter(0), writing_mode_(true){
-	responder_=stub_->PrepareAsyncPushNewOrder(&context, &cq_);
-	responder_->StartCall((void*)this);
-	callStatus=PROCESS;
-}
-
-void AsyncClientCallPushNewOrder::Proceed(bool ok){
-	// sleep(1);
-	if(callStatus==PROCESS){
-		if(writing_mode_){
-			if(counter<requests_.size()){
-				//std::cout<<"Writing request..."<<std::endl;	
-				//printRequest(requests_[counter]);
-				responder_->Write(requests_[counter], (void*)this);
-				++counter;				
-			}else{
-				//std::cout<<"Writing done!"<<std::endl;
-				responder_->WritesDone((void*)this);
-				writing_mode_=false;	
-			}
-		}else{
-			if(!ok){
-				//std::cout<<"Read finish!"<<std::endl;
-				// callStatus=FINISH;
-				// responder_->Finish(&status, (void*)this);	
-			}else{
-				//std::cout<<"Reading report..."<<std::endl;
-				responder_->Read(&report_, (void*)this);	
-				if(report_.clientid()>0){
-					printReport(report_);
-				}
-			}
-		}
-	}else if(callStatus==FINISH){
-		std::cout<<"Delete!"<<std::endl;
-		delete this;
-	}
-}
-
 // 查询订单类
-AsyncClientCallPushQueryOrder::AsyncClientCallPushQueryOrder(const QueryOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
-	AbstractAsyncClientCall(), reportsCounter(0){
+AsyncClientCallPushQueryOrder::AsyncClientCallPushQueryOrder(const QueryOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_, const uint64_t& counter):
+	AbstractAsyncClientCall(), reportsCounter(counter), pageCounter(0), lastOrderID(0), cq(cq_), stub(stub_){
 		responder = stub_->AsyncPushQueryOrder(&context, request, &cq_, (void*)this);
 		callStatus = PROCESS ;
 }
@@ -126,7 +250,10 @@ void AsyncClientCallPushQueryOrder::Proceed(bool ok){
 		if(!ok){
 			responder->Finish(&status, (void*)this);
 			callStatus = FINISH;
-			if(reportsCounter==0){
+			if(pageCounter>=QUERY_PAGE_SIZE){
+				// 满页: 从本页最后一笔订单之后继续查询
+				new AsyncClientCallPushQueryOrder(MakeQueryOrderRequest(lastOrderID), cq, stub, reportsCounter);
+			}else if(reportsCounter==0){
 				std::cout<<"无订单！"<<std::endl;
 			}
 			return ;
@@ -135,6 +262,8 @@ void AsyncClientCallPushQueryOrder::Proceed(bool ok){
 		if(queryReport_.clientid()>0) {
 			printReport(queryReport_);
 			reportsCounter++;
+			pageCounter++;
+			lastOrderID=queryReport_.orderid();
 		}
 	}
 	else if(callStatus == FINISH){
@@ -144,21 +273,42 @@ void AsyncClientCallPushQueryOrder::Proceed(bool ok){
 
 // 客户端类
 OPSClient::OPSClient(std::shared_ptr<Channel> channel):
-		stub_(OrderService::NewStub(channel)){}
+		stub_(OrderService::NewStub(channel)), nextClOrdID_(1){
+	// 建立报单流
+	orderEntry_.reset(new AsyncClientCallOrderEntry(cq_, stub_));
+}
 
 // 提交订单
 void OPSClient::PushNewOrder(const std::string& fileName){
-	std::vector<NewOrderRequest> requests;
-	readNewOrderRequest(fileName, requests);
-	// 注册报单请求处理
-	new AsyncClientCallPushNewOrder(std::move(requests), cq_, stub_);
+	std::vector<NewOrderRequest> orders;
+	readNewOrderRequest(fileName, orders);
+	std::vector<OrderEntryRequest> requests(orders.size());
+	for(size_t i=0;i<orders.size();i++){
+		orders[i].set_clordid(nextClOrdID_++);
+		requests[i].mutable_neworder()->Swap(&orders[i]);
+	}
+	orderEntry_->send(std::move(requests));
 }
 
-// 删除订单
+// 撤销订单
 void OPSClient::PushCancelOrder(const uint64_t& orderID){
-	CancelOrderRequest request=MakeCancelOrderRequest(orderID);
-	// 注册撤单请求处理
-	new AsyncClientCallPushCancelOrder(request, cq_, stub_);
+	std::vector<OrderEntryRequest> requests(1);
+	*requests[0].mutable_cancelorder()=MakeCancelOrderRequest(orderID);
+	orderEntry_->send(std::move(requests));
+}
+
+// 改单
+void OPSClient::AmendOrder(const uint64_t& orderID, const uint32_t& orderQty, const double& price){
+	std::vector<OrderEntryRequest> requests(1);
+	*requests[0].mutable_amendorder()=MakeAmendOrderRequest(orderID, orderQty, price);
+	orderEntry_->send(std::move(requests));
+}
+
+// 批量撤单
+void OPSClient::MassCancel(const uint64_t& clientID, const std::string& stockID, const std::string& side){
+	MassCancelRequest request=MakeMassCancelRequest(clientID, stockID, side);
+	// 注册批量撤单请求处理
+	new AsyncClientCallMassCancel(request, cq_, stub_);
 }
 
 // 查询订单
@@ -174,16 +324,16 @@ void OPSClient::AsyncCompleteRpc(){
 	bool ok=false;
 	// 从完成队列中取出请求处理
 	while(cq_.Next(&got_tag, &ok)){
-		// 基类指针,根据子类执行的虚函数Proceed()
-		AbstractAsyncClientCall* call=static_cast<AbstractAsyncClientCall*>(got_tag);
-		call->Proceed(ok);
+		// 标签指针,根据标签类型执行虚函数Proceed()
+		CompletionTag* tag=static_cast<CompletionTag*>(got_tag);
+		tag->Proceed(ok);
 	}
 }
 
 int main(int argc, char* argv[]){
 	OPSClient client(grpc::CreateChannel("localhost:50010", grpc::InsecureChannelCredentials()));
 	std::thread thread_=std::thread(&OPSClient::AsyncCompleteRpc, &client);
-	std::cout<<"Please input operator and requests! usage: <New/ Cancel> <RequestsFile/ orderID>"<<std::endl;
+	std::cout<<"Please input operator and requests! usage: <New/ Cancel/ Amend/ Mass/ Query> <RequestsFile/ orderID/ orderID orderQty price/ clientID stockID|* SELL|BUY|*>"<<std::endl;
 	while(1){
 		std::string op;
 		std::cin>>op;
@@ -195,6 +345,17 @@ int main(int argc, char* argv[]){
 			uint64_t orderID;
 			std::cin>>orderID;
 			client.PushCancelOrder(orderID);
+		}else if(op=="Amend"||op=="A"||op=="amend"||op=="a"){
+			uint64_t orderID;
+			uint32_t orderQty;
+			double price;
+			std::cin>>orderID>>orderQty>>price;
+			client.AmendOrder(orderID, orderQty, price);
+		}else if(op=="Mass"||op=="M"||op=="mass"||op=="m"){
+			uint64_t clientID;
+			std::string stockID, side;
+			std::cin>>clientID>>stockID>>side;
+			client.MassCancel(clientID, stockID, side);
 		}else if(op=="Query"||op=="Q"||op=="query"||op=="q"){
 			client.PushQueryOrder();
 		}
@@ -4,6 +4,8 @@
 #include <string>
 #include <memory>
 #include <thread>
+#include <mutex>
+#include <deque>
 #include <time.h>
 #include <unistd.h>
 #include <functional>
@@ -14,9 +16,11 @@
 #include <fstream>
 #include <iostream>
 #include "../helper/helper.h"
+#include "../helper/completion_tag.h"
 #include "assert.h"
 
 #include <grpc++/grpc++.h>
+#include <grpcpp/alarm.h>
 #include <grpc/support/log.h>
 #include "../proto/OrderProcessSystem.grpc.pb.h"
 
@@ -24,6 +28,12 @@
 #define TYPE_MARKET false
 #define DIRE_SELL true
 #define DIRE_BUY false
+// 查询订单每页的订单数
+#define QUERY_PAGE_SIZE 100
+// 报单流每帧最多携带的请求数
+#define ORDER_ENTRY_BATCH_SIZE 64
+// 报单流断开后的重连间隔(秒)
+#define RECONNECT_INTERVAL 1
 
 using grpc::Channel;
 using grpc::ClientContext;
@@ -36,8 +46,16 @@ using grpc::Status;
 
 using OPS::NewOrderRequest;
 using OPS::CancelOrderRequest;
+using OPS::AmendOrderRequest;
+using OPS::OrderEntryRequest;
+using OPS::OrderEntryBatch;
+using OPS::LogonRequest;
+using OPS::LogonReport;
+using OPS::MassCancelRequest;
+using OPS::MassCancelReport;
 using OPS::QueryOrderRequest;
 using OPS::ExecutionReport;
+using OPS::ExecutionReportBatch;
 using OPS::OrderReport;
 using OPS::OrderService;
 
@@ -49,14 +67,20 @@ NewOrderRequest MakeNewOrderRequest(const bool&, const bool&,
 // 创建撤销订单请求
 CancelOrderRequest MakeCancelOrderRequest(const uint64_t&);
 
+// 创建改单请求
+AmendOrderRequest MakeAmendOrderRequest(const uint64_t&, const uint32_t&, const double&);
+
+// 创建批量撤单请求
+MassCancelRequest MakeMassCancelRequest(const uint64_t&, const std::string&, const std::string&);
+
 // 创建查询订单请求
-QueryOrderRequest MakeQueryOrderRequest();
+QueryOrderRequest MakeQueryOrderRequest(const uint64_t& =0);
 
 // 读入新订单文件
 void readNewOrderRequest(const std::string&, std::vector<NewOrderRequest>&);
 
 // 抽象类
-class AbstractAsyncClientCall{
+class AbstractAsyncClientCall:public CompletionTag{
 public:
     // 状态机
 	enum CallStatus {PROCESS, FINISH, DESTROY};
@@ -68,27 +92,73 @@ public:
 	CallStatus callStatus;
 	ExecutionReport report_;
 	OrderReport queryReport_;
-	virtual void Proceed(bool = true) = 0;
+	virtual void Proceed(bool = true) override = 0;
 };
 
-// 撤销订单类
-class AsyncClientCallPushCancelOrder: public AbstractAsyncClientCall{
+// 报单流类：客户端只建立一个报单会话, 新订单、撤单和改单都在报单流上按提交顺序发送
+// 读写各用一个标签同时进行; 提交的请求先进入待发队列, 任一时刻只有一个写操作在进行, 写完成后再合并为一帧写出
+// 报单流断开后每隔RECONNECT_INTERVAL秒重连, 凭会话令牌和收到的最后一条应答的序号续传, 只重发断开期间的应答
+class AsyncClientCallOrderEntry:public CompletionTag{
 private:
-	std::unique_ptr<ClientAsyncResponseReader<ExecutionReport> > responder;
+	CompletionQueue& cq_;
+	std::unique_ptr<OrderService::Stub>& stub_;
+	// 以下每次连接重建
+	std::unique_ptr<ClientContext> context_;
+	std::unique_ptr<ClientAsyncReaderWriter<OrderEntryBatch, ExecutionReportBatch> >responder_;
+	Status status_;
+	MemberTag<AsyncClientCallOrderEntry> readTag_;
+	MemberTag<AsyncClientCallOrderEntry> writeTag_;
+	MemberTag<AsyncClientCallOrderEntry> finishTag_;
+	MemberTag<AsyncClientCallOrderEntry> alarmTag_;
+	// 保护以下写状态, 提交线程和完成队列线程都会访问
+	std::mutex mutex_;
+	// 待发送的请求, 断开期间提交的请求在重连后发出
+	std::deque<OrderEntryRequest> pending_;
+	// 正在写出的一帧请求, 写操作完成前必须保持有效
+	OrderEntryBatch writing_batch_;
+	// 已收到登录应答, 可以发送请求
+	bool loggedOn_;
+	// 有写操作在进行
+	bool writing_;
+	// 读已结束, 写操作完成后结束流
+	bool readDone_;
+	// 以下只由完成队列线程访问
+	// 会话令牌, 0表示还没有会话
+	uint64_t token_;
+	// 收到的最后一条应答的序号
+	uint64_t lastSeq_;
+	ExecutionReportBatch reportBatch_;
+	// 重连延时
+	grpc::Alarm alarm_;
+	// 建立报单流
+	void connect();
+	// 读完成
+	void OnRead(bool);
+	// 写完成
+	void OnWrite(bool);
+	// 结束完成
+	void OnFinish(bool);
+	// 重连
+	void OnAlarm(bool);
+	// 写出下一帧请求, 没有待发请求时结束写状态(须持有mutex_)
+	void WriteNext();
+	// 结束流(须持有mutex_, 且没有进行中的写操作)
+	void finish();
 public:
-	AsyncClientCallPushCancelOrder(const CancelOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
+	AsyncClientCallOrderEntry(CompletionQueue& cq, std::unique_ptr<OrderService::Stub>& stub);
+	// 流建立
 	virtual void Proceed(bool ok = true) override;
+	// 提交请求(任意线程)
+	void send(std::vector<OrderEntryRequest>&& requests);
 };
 
-// 提交订单类
-class AsyncClientCallPushNewOrder:public AbstractAsyncClientCall{
+// 批量撤单类
+class AsyncClientCallMassCancel: public AbstractAsyncClientCall{
 private:
-	std::unique_ptr<ClientAsyncReaderWriter<NewOrderRequest, ExecutionReport> >responder_;
-	uint32_t counter;
-	bool writing_mode_;
-	std::vector<NewOrderRequest> requests_;
+	std::unique_ptr<ClientAsyncResponseReader<MassCancelReport> > responder;
+	MassCancelReport massCancelReport_;
 public:
-	AsyncClientCallPushNewOrder(std::vector<NewOrderRequest>&& requests, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
+	AsyncClientCallMassCancel(const MassCancelRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
 	virtual void Proceed(bool ok = true) override;
 };
 
@@ -97,8 +167,13 @@ class AsyncClientCallPushQueryOrder:public AbstractAsyncClientCall{
 private:
 	std::unique_ptr< ClientAsyncReader<OrderReport> > responder;
 	uint64_t reportsCounter;
+	// 本页收到的订单数及最后一笔订单的ID, 满页时以其为游标查询下一页
+	uint32_t pageCounter;
+	uint64_t lastOrderID;
+	CompletionQueue& cq;
+	std::unique_ptr<OrderService::Stub>& stub;
 public:
-	AsyncClientCallPushQueryOrder(const QueryOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
+	AsyncClientCallPushQueryOrder(const QueryOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_, const uint64_t& =0);
 	virtual void Proceed(bool ok = true) override;
 };
 
@@ -108,12 +183,20 @@ class OPSClient{
 private:
 	std::unique_ptr<OrderService::Stub>stub_;
 	CompletionQueue cq_;
+	// 报单流
+	std::unique_ptr<AsyncClientCallOrderEntry> orderEntry_;
+	// 下一个客户订单ID, 执行结果中回传, 用于对应发出的订单
+	uint64_t nextClOrdID_;
 public:
 	explicit OPSClient(std::shared_ptr<Channel> channel);
-	// 提交订单
+	// 提交订单, 新订单、撤单和改单都经报单流发送
 	void PushNewOrder(const std::string& fileName);
 	// 撤销订单
 	void PushCancelOrder(const uint64_t& orderID);
+	// 修改订单的数量和价格, 0表示不修改
+	void AmendOrder(const uint64_t& orderID, const uint32_t& orderQty, const double& price);
+	// 批量撤单, stockID与side为"*"时不过滤
+	void MassCancel(const uint64_t& clientID, const std::string& stockID, const std::string& side);
 	// 查询订单
 	void PushQueryOrder();
 	// 异步处理完成队列中的事件
@@ -2,64 +2,481 @@
 
 // 基类
 CommonCallData::CommonCallData(OrderService::AsyncService* service, ServerCompletionQueue* cq, TradingMarket* tradingMarket):
-	service_(service), cq_(cq), tradingMarket_(tradingMarket), status_(CREATE){}
+	service_(service), cq_(cq), owner_(NO_SESSION), tradingMarket_(tradingMarket), status_(CREATE){}
 
-// 处理新订单类
-CallDataPushNewOrder::CallDataPushNewOrder(OrderService::AsyncService* service, ServerCompletionQueue* cq, TradingMarket* tradingMarket):
-		CommonCallData(service, cq, tradingMarket), responder_(&ctx_), new_responder_created_(false), writing_mode_(false), RequestsCounter_(0), ReportsCounter_(0){
-	Proceed();
+// 启动落盘闸门的释放线程
+void DurableGate::start(TradingMarket* market){
+	market_=market;
+	thread_=std::thread(&DurableGate::loop, this);
 }
 
-void CallDataPushNewOrder::Proceed(bool ok) {
-	if(status_==CREATE){
-		//std::cout<<"Create call data!"<<std::endl;
-		status_=PROCESS;
-		service_->RequestPushNewOrder(&ctx_, &responder_, cq_, cq_, (void*)this);	
-	}else if(status_==PROCESS){
-		if(!new_responder_created_){
-			new CallDataPushNewOrder(service_, cq_, tradingMarket_);
-			new_responder_created_=true;
+// 停止释放线程
+void DurableGate::stop(){
+	if(!thread_.joinable()) return;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_=true;
+	}
+	cv_.notify_one();
+	thread_.join();
+}
+
+// 登记待发操作
+void DurableGate::hold(const uint64_t& seq, std::function<void()>&& action){
+	if(!enabled()){
+		action();
+		return;
+	}
+	bool wasEmpty;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		wasEmpty=held_.empty();
+		held_.emplace_back(seq, std::move(action));
+	}
+	if(wasEmpty) cv_.notify_one();
+}
+
+// 释放线程主循环: 一次组提交覆盖一批登记, 批内按登记顺序执行
+void DurableGate::loop(){
+	std::vector<std::pair<uint64_t, std::function<void()> > > batch;
+	for(;;){
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [this](){return stop_||!held_.empty();});
+			if(held_.empty()) return;
+			batch.swap(held_);
 		}
-		if(!writing_mode_){
-			if(!ok){
-				//std::cout<<"Reading finish!"<<std::endl;
-				writing_mode_=true;
-				ok=true;	
-			}else{
-				//std::cout<<"Reading request..."<<std::endl;
-				responder_.Read(&newOrderRequest_, (void*)this);
-				// printRequest(newOrderRequest_);
-				if(newOrderRequest_.clientid()>0){
-					uint64_t orderID=0;
-					tradingMarket_->processNewOrder(newOrderRequest_, reports_, orderID);
-					if(orderID>0){
-						(orderID_responder_)[orderID]=&responder_;
-					}
-				}
-			}		
+		uint64_t seq=0;
+		for(auto& item:batch) seq=std::max(seq, item.first);
+		market_->waitDurable(seq);
+		for(auto& item:batch) item.second();
+		batch.clear();
+	}
+}
+
+// 会话表
+SessionRegistry::SessionRegistry():states_(new SessionState[MAX_SESSIONS]){
+	std::random_device rd;
+	salt_=((uint64_t)rd()<<16)^rd();
+	// 从小到大分配会话ID
+	for(uint32_t i=0;i<MAX_SESSIONS;i++){
+		free_.push_back((SessionID)(MAX_SESSIONS-1-i));
+	}
+}
+
+// 建立新会话
+SessionID SessionRegistry::open(CallDataOrderEntry* stream, const SessionLimits& limits){
+	std::unique_lock<std::mutex> lk(mutex_);
+	SessionID id=NO_SESSION;
+	if(!free_.empty()){
+		id=free_.back();
+		free_.pop_back();
+	}else{
+		// 没有空闲槽位时回收最早断开且挂单已全部离开订单簿的会话
+		auto market=TradingMarket::getInstance();
+		for(size_t i=0;i<detached_.size();i++){
+			if(market->sessionOrders(detached_[i])==0){
+				id=detached_[i];
+				detached_.erase(detached_.begin()+i);
+				break;
+			}
 		}
-		if(writing_mode_){
-			if(!ok||ReportsCounter_>=reports_.size()){
-				//std::cout<<"Writing done!"<<std::endl;
-				//status_=FINISH;
-				//responder_.Finish(Status(), (void*)this);	
-			}else{
-				//std::cout<<"Writing report..."<<std::endl;
-				auto& orderID= reports_[ReportsCounter_].first;
-				auto& report=reports_[ReportsCounter_].second;
-				// printReport(report);
-				if(orderID==0){
-					responder_.Write(report, (void*)this);
-				}else{
-					orderID_responder_[orderID]->Write(report, (void*)this);
+		if(id==NO_SESSION) return NO_SESSION;
+	}
+	auto& state=states_[id];
+	std::unique_lock<std::mutex> slot(state.mutex);
+	state.stream=stream;
+	state.generation++;
+	state.token=((salt_+state.generation)<<16)|id;
+	state.nextSeq=1;
+	std::vector<ExecutionReport>().swap(state.ring);
+	state.ringSize=limits.ring;
+	state.dedup.reset(new DedupWindow(limits.dedup));
+	state.clients.clear();
+	return id;
+}
+
+// 续传会话
+SessionID SessionRegistry::resume(CallDataOrderEntry* stream, const uint64_t& token, const uint64_t& lastSeq, uint64_t& nextSeq, bool& busy){
+	busy=false;
+	SessionID id=(SessionID)(token&0xffff);
+	if(id>=MAX_SESSIONS) return NO_SESSION;
+	// 持有表锁, 续传期间会话不会被回收
+	std::unique_lock<std::mutex> lk(mutex_);
+	auto& state=states_[id];
+	std::unique_lock<std::mutex> slot(state.mutex);
+	if(state.token!=token) return NO_SESSION;
+	if(state.stream!=nullptr){
+		busy=true;
+		return NO_SESSION;
+	}
+	// 重传环中最早的序号之前的应答已被覆盖, 从最早的序号开始重发
+	uint64_t first=state.nextSeq-state.ring.size();
+	nextSeq=std::min(std::max(lastSeq+1, first), state.nextSeq);
+	for(uint64_t seq=nextSeq;seq<state.nextSeq;seq++){
+		stream->enqueue(state.ring[(seq-1)%state.ringSize]);
+	}
+	// 之后的应答直接投递到新的报单流, 排在重发的应答之后
+	state.stream=stream;
+	detached_.erase(std::find(detached_.begin(), detached_.end(), id));
+	return id;
+}
+
+// 摘除报单流
+void SessionRegistry::detach(const SessionID& id){
+	std::unique_lock<std::mutex> lk(mutex_);
+	{
+		// 等待正在进行的投递完成
+		std::unique_lock<std::mutex> slot(states_[id].mutex);
+		states_[id].stream=nullptr;
+	}
+	detached_.push_back(id);
+}
+
+// 为应答编号并投递到会话
+bool SessionRegistry::deliver(const SessionID& id, const ExecutionReport& report){
+	auto& state=states_[id];
+	std::unique_lock<std::mutex> slot(state.mutex);
+	if(state.token==0) return false;
+	// 合并状态下暂不编号, 写出合并结果时再编号
+	if(state.stream!=nullptr&&state.stream->conflate(report)) return true;
+	auto& stored=record(state, report);
+	if(state.stream!=nullptr) state.stream->enqueue(stored);
+	return true;
+}
+
+// 为应答编号并存入重传环
+ExecutionReport& SessionRegistry::record(SessionState& state, const ExecutionReport& report){
+	uint64_t seq=state.nextSeq++;
+	ExecutionReport* stored;
+	if(state.ring.size()<state.ringSize){
+		state.ring.push_back(report);
+		stored=&state.ring.back();
+	}else{
+		stored=&state.ring[(seq-1)%state.ringSize];
+		*stored=report;
+	}
+	stored->set_seq(seq);
+	return *stored;
+}
+
+// 处理报单流类
+CallDataOrderEntry::CallDataOrderEntry(OrderService::AsyncService* service, ServerCompletionQueue* cq, TradingMarket* tradingMarket):
+		CommonCallData(service, cq, tradingMarket), responder_(&ctx_),
+		readTag_(this, &CallDataOrderEntry::OnRead), writeTag_(this, &CallDataOrderEntry::OnWrite),
+		alarmTag_(this, &CallDataOrderEntry::OnAlarm), finishTag_(this, &CallDataOrderEntry::OnFinish),
+		doneTag_(this, &CallDataOrderEntry::OnDone), session_(NO_SESSION), state_(nullptr), logonPending_(false), queued_(0), writing_(false),
+		conflating_(false), slow_(false), closed_(false), reading_(false), finishing_(false), done_(false){
+	// 流结束时得到通知, 须在请求之前注册
+	ctx_.AsyncNotifyWhenDone(&doneTag_);
+	service_->RequestOrderEntry(&ctx_, &responder_, cq_, cq_, (CompletionTag*)this);
+}
+
+// 报单流建立：读第一帧, 由其中的登录请求决定建立还是续传会话
+void CallDataOrderEntry::Proceed(bool ok) {
+	if(!ok) return;
+	status_=PROCESS;
+	new CallDataOrderEntry(service_, cq_, tradingMarket_);
+	reading_=true;
+	responder_.Read(&entryBatch_, &readTag_);
+}
+
+// 建立或续传会话
+bool CallDataOrderEntry::logon(){
+	uint64_t token=0;
+	uint64_t lastSeq=0;
+	if(entryBatch_.requests_size()>0&&entryBatch_.requests(0).has_logon()){
+		token=entryBatch_.requests(0).logon().sessiontoken();
+		lastSeq=entryBatch_.requests(0).logon().lastseq();
+	}
+	uint64_t nextSeq=1;
+	bool busy=false;
+	if(token==0){
+		session_=registry_.open(this, limits_);
+	}else{
+		session_=registry_.resume(this, token, lastSeq, nextSeq, busy);
+	}
+	if(session_==NO_SESSION){
+		closed_.store(true);
+		finishing_=true;
+		if(token==0){
+			responder_.Finish(Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Too many sessions"), &finishTag_);
+		}else if(busy){
+			// 客户端稍后重试即可
+			responder_.Finish(Status(grpc::StatusCode::UNAVAILABLE, "Session is still connected"), &finishTag_);
+		}else{
+			responder_.Finish(Status(grpc::StatusCode::NOT_FOUND, "Session not found"), &finishTag_);
+		}
+		return false;
+	}
+	state_=&registry_.state(session_);
+	// 登录应答随第一帧写出, 排在重发的应答之前
+	logonReport_.set_sessiontoken(state_->token);
+	logonReport_.set_nextseq(nextSeq);
+	logonPending_=true;
+	wake();
+	return true;
+}
+
+// 读完成：按到达顺序逐个处理一帧中的请求, 应答分发到各订单所属会话的出站队列, 然后读下一帧
+void CallDataOrderEntry::OnRead(bool ok){
+	reading_=false;
+	if(!ok||done_){
+		// 客户端写完时本流保持打开, 继续推送后续成交
+		TryRelease();
+		return;
+	}
+	if(session_==NO_SESSION&&!logon()) return;
+	for(auto& request:entryBatch_.requests()){
+		processEntry(request);
+	}
+	reading_=true;
+	responder_.Read(&entryBatch_, &readTag_);
+}
+
+// 处理一个报单流请求: 订单簿中产生的应答已由应答回调投递到订单所属会话, 这里只回复请求方另需的应答
+void CallDataOrderEntry::processEntry(const OrderEntryRequest& request){
+	switch(request.request_case()){
+	case OrderEntryRequest::kNewOrder:{
+		auto& order=request.neworder();
+		// printRequest(order);
+		if(order.clientid()==0) return;
+		uint64_t orderID=0;
+		// 客户订单ID已在本会话中下单: 不再撮合, 回复原订单ID
+		if(order.clordid()>0&&state_->dedup->find(order.clordid(), orderID)){
+			initReport(report_, order);
+			report_.set_stat(ExecutionReport::ORDER_DUPLICATE);
+			report_.set_orderid(orderID);
+			report_.set_time(getTime());
+			reply(report_);
+			return;
+		}
+		state_->clients.insert(order.clientid());
+		reports_.clear();
+		processNewOrder(*tradingMarket_, order, session_, reports_, orderID);
+		for(auto& report:reports_){
+			// printReport(report.second);
+			if(report.first==NO_SESSION) reply(report.second);
+		}
+		// 只记录已接受的订单, 被拒绝的订单重发时重新检查
+		if(order.clordid()>0&&orderID>0) state_->dedup->insert(order.clordid(), orderID);
+		break;
+	}
+	case OrderEntryRequest::kCancelOrder:
+		// printRequest(request.cancelorder());
+		processCancelOrder(*tradingMarket_, request.cancelorder(), report_, owner_);
+		// 撤单应答已投递到订单所属会话; 撤单失败或撤销其他会话的订单时再回复本会话
+		if(owner_!=session_) reply(report_);
+		break;
+	case OrderEntryRequest::kAmendOrder:
+		// printRequest(request.amendorder());
+		reports_.clear();
+		processAmendOrder(*tradingMarket_, request.amendorder(), reports_);
+		// 改单失败的应答, 以及修改其他会话的订单时该订单自身的应答, 回复本会话
+		for(auto& report:reports_){
+			if(report.first==NO_SESSION||(report.first!=session_&&report.second.orderid()==request.amendorder().orderid())){
+				reply(report.second);
+			}
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+// 回复请求方
+void CallDataOrderEntry::reply(const ExecutionReport& report){
+	if(!durable_.enabled()){
+		deliver(session_, report);
+		return;
+	}
+	SessionID session=session_;
+	auto copy=std::make_shared<ExecutionReport>(report);
+	durable_.hold(tradingMarket_->journalSeq(), [session, copy](){
+		deliver(session, *copy);
+	});
+}
+
+// 撮合核心的应答回调: 持订单簿锁(或在撮合线程中)登记, 之后撮合的应答不会越过它们
+void CallDataOrderEntry::deliverReports(const std::pair<SessionID, Execution>* execs, const size_t& count, const uint64_t& seq){
+	auto reports=std::make_shared<std::vector<std::pair<SessionID, ExecutionReport> > >();
+	reports->reserve(count);
+	for(size_t i=0;i<count;i++){
+		// 会话ID为NO_SESSION的拒绝应答由请求方处理
+		if(execs[i].first==NO_SESSION) continue;
+		reports->emplace_back();
+		reports->back().first=execs[i].first;
+		toReport(execs[i].second, reports->back().second);
+	}
+	if(reports->empty()) return;
+	durable_.hold(seq, [reports](){
+		for(auto& report:*reports) deliver(report.first, report.second);
+	});
+}
+
+// 写完成
+void CallDataOrderEntry::OnWrite(bool ok){
+	if(!ok){
+		// 客户端已断开, 之后的应答全部丢弃
+		closed_.store(true);
+	}
+	WriteNext();
+}
+
+// 被其他线程唤醒
+void CallDataOrderEntry::OnAlarm(bool ok){
+	WriteNext();
+}
+
+// 结束完成
+void CallDataOrderEntry::OnFinish(bool ok){
+	finishing_=false;
+	TryRelease();
+}
+
+// 流结束：从会话摘除, 之后不会再有应答入队, 会话保留以供续传
+void CallDataOrderEntry::OnDone(bool ok){
+	closed_.store(true);
+	if(session_!=NO_SESSION){
+		if(slow_.load()) std::cout<<"Session "<<session_<<" disconnected: slow consumer"<<std::endl;
+		// 断开并撤单策略: 撤销本会话提交的全部挂单, 撤单在摘除之前进行, 续传的报单流不会与之并发访问会话状态
+		if(limits_.policy==SLOW_CANCEL&&!state_->clients.empty()){
+			MassCancelReport report;
+			cancelSessionOrders(*tradingMarket_, session_, state_->clients, report);
+			if(report.canceledorders()>0){
+				std::cout<<"Session "<<session_<<" canceled "<<report.canceledorders()<<" orders on disconnect"<<std::endl;
+				// 每笔被撤订单一条撤单应答, 编号存入会话的重传环, 续传时重发
+				auto canceled=std::make_shared<std::vector<ExecutionReport> >(report.orderids_size());
+				for(int i=0;i<report.orderids_size();i++){
+					auto& cancel=(*canceled)[i];
+					cancel.set_stat(ExecutionReport::CANCELED);
+					cancel.set_orderid(report.orderids(i));
+					cancel.set_time(report.time());
 				}
-				++ReportsCounter_;
+				SessionID session=session_;
+				durable_.hold(tradingMarket_->journalSeq(), [session, canceled](){
+					for(auto& cancel:*canceled) registry_.deliver(session, cancel);
+				});
 			}
 		}
+		// 尚未写出的合并结果编号存入重传环, 续传时重发
+		flushConflated(false);
+		registry_.detach(session_);
+	}
+	done_=true;
+	TryRelease();
+}
+
+// 写出下一帧应答
+void CallDataOrderEntry::WriteNext(){
+	if(closed_.load()){
+		// 丢弃待写应答并结束写状态
+		pending_.clear();
+		do{
+			outbox_.popAll(pending_);
+			pending_.clear();
+			writing_.store(false);
+		}while(!outbox_.empty()&&!writing_.exchange(true));
+		TryRelease();
+		return;
+	}
+	for(;;){
+		if(pending_.empty()) outbox_.popAll(pending_);
+		// 积压降到低水位时写出合并的应答, 恢复逐条推送
+		if(conflating_.load()&&queued_.load()<=limits_.low) flushConflated(true);
+		if(!pending_.empty()||logonPending_) break;
+		writing_.store(false);
+		// 入队者可能在popAll之后、writing_置为false之前入队, 此时它没有唤醒会话, 需要重新检查
+		if((outbox_.empty()&&!conflating_.load())||writing_.exchange(true)) return;
+	}
+	// 写操作进行期间积累的应答已一并取出, 合并为一帧写出
+	writing_batch_.Clear();
+	if(logonPending_){
+		*writing_batch_.mutable_logon()=logonReport_;
+		logonPending_=false;
+	}
+	while(!pending_.empty()&&(size_t)writing_batch_.reports_size()<MAX_REPORT_BATCH){
+		writing_batch_.add_reports()->Swap(&pending_.front());
+		pending_.pop_front();
+	}
+	queued_.fetch_sub(writing_batch_.reports_size());
+	responder_.Write(writing_batch_, &writeTag_);
+}
+
+// 流已结束且没有进行中的操作时释放会话
+void CallDataOrderEntry::TryRelease(){
+	// 注销后只有本线程会修改writing_
+	if(done_&&!reading_&&!finishing_&&!writing_.load()){
+		delete this;
+	}
+}
+
+// 应答入队：同一会话的入队者由会话表的槽位锁串行化
+void CallDataOrderEntry::enqueue(const ExecutionReport& report){
+	if(closed_.load()) return;
+	// 积压超过高水位, 按慢消费者策略处理; 合并策略下新的应答在编号前已合并, 已编号的应答(续传重发)照常入队
+	if(queued_.load()>=limits_.high&&limits_.policy!=SLOW_CONFLATE){
+		if(!slow_.exchange(true)){
+			// 断开会话: 之后的应答全部丢弃, 流结束后在OnDone中清理
+			closed_.store(true);
+			ctx_.TryCancel();
+		}
+		return;
+	}
+	queued_.fetch_add(1);
+	outbox_.push(report);
+	wake();
+}
+
+// 唤醒会话：会话空闲时由入队者负责唤醒, 唤醒事件在会话所在的工作线程上处理
+void CallDataOrderEntry::wake(){
+	if(!writing_.exchange(true)){
+		alarm_.Set(cq_, gpr_now(GPR_CLOCK_MONOTONIC), &alarmTag_);
+	}
+}
+
+// 合并一条应答: 同一订单连续的成交合并为一条, 成交数量累加, 其余字段为最近一次成交的状态
+// 接受、撤单、改单和各种拒绝应答不合并, 按到达顺序保留
+bool CallDataOrderEntry::conflate(const ExecutionReport& report){
+	if(limits_.policy!=SLOW_CONFLATE||closed_.load()) return false;
+	// 积压超过高水位时进入合并状态
+	if(!conflating_.load()&&queued_.load()<limits_.high) return false;
+	conflating_.store(true);
+	if(report.stat()!=ExecutionReport::FILL){
+		// 之后的成交不能越过这条应答并入更早的成交
+		conflatedIndex_.erase(report.orderid());
+		conflated_.push_back(report);
 	}else{
-		std::cout<<"Delete!"<<std::endl;
-		// delete this;
-	}	
+		auto it=conflatedIndex_.find(report.orderid());
+		if(it==conflatedIndex_.end()){
+			conflatedIndex_.insert(std::make_pair(report.orderid(), conflated_.size()));
+			conflated_.push_back(report);
+		}else{
+			auto& last=conflated_[it->second];
+			uint32_t fillQty=last.fillqty()+report.fillqty();
+			last=report;
+			last.set_fillqty(fillQty);
+		}
+	}
+	wake();
+	return true;
+}
+
+// 为合并的应答编号并结束合并状态: 持槽位锁编号, 期间投递的应答都排在合并结果之后
+void CallDataOrderEntry::flushConflated(const bool& send){
+	std::unique_lock<std::mutex> slot(state_->mutex);
+	if(send){
+		// 出站队列中已编号的应答序号更小, 先全部取出
+		outbox_.popAll(pending_);
+		queued_.fetch_add(conflated_.size());
+	}
+	for(auto& report:conflated_){
+		auto& stored=SessionRegistry::record(*state_, report);
+		if(send) pending_.push_back(stored);
+	}
+	conflated_.clear();
+	conflatedIndex_.clear();
+	conflating_.store(false);
 }
 
 // 处理撤销订单
@@ -74,17 +491,92 @@ void CallDataPushCancelOrder::Proceed(bool ok) {
 	}else if(status_==PROCESS){
 		new CallDataPushCancelOrder(service_, cq_, tradingMarket_);
 		// printRequest(cancelOrderRequest_);
-		initReport(report_, cancelOrderRequest_);
-		tradingMarket_->processCancelOrder(cancelOrderRequest_,  report_);
+		processCancelOrder(*tradingMarket_, cancelOrderRequest_, report_, owner_);
 		// printReport(report_);
 		status_=FINISH;
-		responder_.Finish(report_, Status::OK, this);
+		// 撤单记录落盘后应答, 撤单应答已由应答回调投递到订单所属会话的出站队列, 保证会话的应答序列完整
+		durable_.hold(tradingMarket_->journalSeq(), [this](){
+			responder_.Finish(report_, Status::OK, this);
+		});
+	}else{
+		GPR_ASSERT(status_==FINISH);
+		delete this;
+	}
+}
+
+// 处理批量撤单
+CallDataMassCancel::CallDataMassCancel(OrderService::AsyncService* service, ServerCompletionQueue* cq, TradingMarket* tradingMarket):
+		CommonCallData(service, cq, tradingMarket), responder_(&ctx_){
+	Proceed();
+}
+void CallDataMassCancel::Proceed(bool ok) {
+	if(status_==CREATE){
+		status_=PROCESS;
+		service_->RequestMassCancel(&ctx_, &massCancelRequest_, &responder_, cq_, cq_, this);	
+	}else if(status_==PROCESS){
+		new CallDataMassCancel(service_, cq_, tradingMarket_);
+		processMassCancel(*tradingMarket_, massCancelRequest_, massCancelReport_);
+		// printReport(massCancelReport_);
+		status_=FINISH;
+		// 撤单记录落盘后应答
+		durable_.hold(tradingMarket_->journalSeq(), [this](){
+			responder_.Finish(massCancelReport_, Status::OK, this);
+		});
 	}else{
 		GPR_ASSERT(status_==FINISH);
 		delete this;
 	}
 }
 
+// 处理改单
+CallDataAmendOrder::CallDataAmendOrder(OrderService::AsyncService* service, ServerCompletionQueue* cq, TradingMarket* tradingMarket):
+	CommonCallData(service, cq, tradingMarket), responder_(&ctx_), new_responder_created_(false), reportsCounter_(0){
+		Proceed();
+}
+
+void CallDataAmendOrder::Proceed(bool ok){
+	if(status_ == CREATE){
+		status_ = PROCESS ;
+		service_->RequestAmendOrder(&ctx_, &amendOrderRequest_, &responder_, cq_, cq_, this);
+	}
+	else if(status_ == PROCESS){
+		if(!new_responder_created_){
+			new CallDataAmendOrder(service_, cq_, tradingMarket_);
+			new_responder_created_ = true ;
+			// printRequest(amendOrderRequest_);
+			processAmendOrder(*tradingMarket_, amendOrderRequest_, reports_);
+			// 改单订单自身的应答写入本流, 全部应答(包括改单订单自身的)已由应答回调投递到订单所属会话的出站队列
+			// 改单失败的应答会话ID为NO_SESSION, 只写入本流
+			for(auto& report:reports_){
+				if(report.first==NO_SESSION||report.second.orderid()==amendOrderRequest_.orderid()){
+					ownReports_.push_back(report.second);
+				}
+			}
+			// 改单记录落盘后开始写出
+			durable_.hold(tradingMarket_->journalSeq(), [this](){
+				WriteNext();
+			});
+			return;
+		}
+		WriteNext();
+	}
+	else if(status_ == FINISH){
+		delete this;
+	}
+}
+
+// 写出下一条应答, 全部写完后结束
+void CallDataAmendOrder::WriteNext(){
+	if(reportsCounter_ >= ownReports_.size()){
+		status_ = FINISH;
+		responder_.Finish(Status(), (void*)this);
+	}
+	else{
+		responder_.Write(ownReports_[reportsCounter_], (void*)this);
+		++reportsCounter_;
+	}
+}
+
 // 处理查询订单
 CallDataPushQueryOrder::CallDataPushQueryOrder(OrderService::AsyncService* service, ServerCompletionQueue* cq, TradingMarket* tradingMarket):
 	CommonCallData(service, cq, tradingMarket), responder_(&ctx_), new_responder_created_(false), reportsCounter_(0){
@@ -100,7 +592,7 @@ void CallDataPushQueryOrder::Proceed(bool ok){
 		if(!new_responder_created_){
 			new CallDataPushQueryOrder(service_, cq_, tradingMarket_);
 			new_responder_created_ = true ;
-			tradingMarket_->processQueryOrder(queryOrderRequest_, queryOrderReports_);
+			processQueryOrder(*tradingMarket_, queryOrderRequest_, queryOrderReports_);
 		}
 		if(reportsCounter_ >= queryOrderReports_.size()){
 			status_ = FINISH;
@@ -116,45 +608,137 @@ void CallDataPushQueryOrder::Proceed(bool ok){
 	}
 }
 
+// 解析命令行参数
+bool parseOptions(int argc, char** argv, ServerOptions& options){
+	int opt;
+	while((opt=getopt(argc, argv, "a:w:m:pH:L:s:d:r:j:g:Ak:c:"))!=-1){
+		switch(opt){
+		case 'a':
+			options.address=optarg;
+			break;
+		case 'w':
+			options.workers=atoi(optarg);
+			break;
+		case 'm':
+			options.matchThreads=atoi(optarg);
+			break;
+		case 'p':
+			options.pin=true;
+			break;
+		case 'H':
+			options.limits.high=atoi(optarg);
+			break;
+		case 'L':
+			options.limits.low=atoi(optarg);
+			break;
+		case 's':
+			if(strcmp(optarg, "conflate")==0) options.limits.policy=SLOW_CONFLATE;
+			else if(strcmp(optarg, "disconnect")==0) options.limits.policy=SLOW_DISCONNECT;
+			else if(strcmp(optarg, "cancel")==0) options.limits.policy=SLOW_CANCEL;
+			else return false;
+			break;
+		case 'd':
+			options.limits.dedup=atoi(optarg);
+			break;
+		case 'r':
+			options.limits.ring=atoi(optarg);
+			break;
+		case 'j':
+			options.journal=optarg;
+			break;
+		case 'g':
+			options.groupCommitMicros=atoi(optarg);
+			break;
+		case 'A':
+			options.ackBeforeDurable=true;
+			break;
+		case 'k':
+			options.checkpointSeconds=atoi(optarg);
+			break;
+		case 'c':
+			if(strcmp(optarg, "copy")==0) options.checkpointMode=CHECKPOINT_COPY;
+			else if(strcmp(optarg, "fork")==0) options.checkpointMode=CHECKPOINT_FORK;
+			else return false;
+			break;
+		default:
+			return false;
+		}
+	}
+	// 续传时重传环整个进入出站队列, 不能超过低水位, 否则重发本身就会触发慢消费者策略
+	return options.workers>0&&options.matchThreads>=0&&options.limits.low<options.limits.high
+		&&options.limits.ring>0&&options.limits.ring<=options.limits.low&&options.checkpointSeconds>=0;
+}
+
 // 服务端类
 void ServerImpl::Run(){
-	std::string server_address("0.0.0.0:50010");
+	CallDataOrderEntry::setLimits(options_.limits);
 	ServerBuilder builder;
-	builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+	builder.AddListeningPort(options_.address, grpc::InsecureServerCredentials());
 	// 注册服务
 	builder.RegisterService(&service_);
-	// 建立完成队列
-	cq_=builder.AddCompletionQueue();
+	// 每个工作线程建立一个完成队列
+	for(int i=0;i<options_.workers;i++){
+		cqs_.emplace_back(builder.AddCompletionQueue());
+	}
 	server_=builder.BuildAndStart();
-	std::cout<<"Server listening on: "<<server_address<<std::endl;	
-	// 处理服务器的主循环
-	for(int i=0;i<9;i++){
-		// 创建多线程处理
-		std::thread thread_=std::thread(&ServerImpl::HandleRpcs, this);
-		thread_.join();
+	std::cout<<"Server listening on: "<<options_.address<<", workers: "<<options_.workers
+		<<", match threads: "<<options_.matchThreads<<std::endl;
+	// 启动工作线程, 绑定CPU时工作线程依次占用第0~workers-1个CPU
+	std::vector<std::thread> threads;
+	for(int i=0;i<options_.workers;i++){
+		threads.emplace_back(&ServerImpl::HandleRpcs, this, cqs_[i].get());
+		if(options_.pin) pinThread(threads.back(), i);
+	}
+	for(auto& thread:threads){
+		thread.join();
 	}
 }
 
 // 主循环
-void ServerImpl::HandleRpcs(){
-	// 注册请求处理
-	new CallDataPushNewOrder(&service_, cq_.get(), tradingMarket_);
-	new CallDataPushCancelOrder(&service_, cq_.get(), tradingMarket_);
-	new CallDataPushQueryOrder(&service_, cq_.get(), tradingMarket_);
+void ServerImpl::HandleRpcs(ServerCompletionQueue* cq){
+	// 在本线程的完成队列上注册请求处理, 请求在哪个完成队列上到达就由哪个线程处理
+	new CallDataOrderEntry(&service_, cq, tradingMarket_);
+	new CallDataPushCancelOrder(&service_, cq, tradingMarket_);
+	new CallDataPushQueryOrder(&service_, cq, tradingMarket_);
+	new CallDataAmendOrder(&service_, cq, tradingMarket_);
+	new CallDataMassCancel(&service_, cq, tradingMarket_);
 	void* tag;
 	bool ok;
 	// 从完成队列中取出请求处理
-	while(true){
-		// 当WriteDone时ok为0
-		GPR_ASSERT(cq_->Next(&tag, &ok));
-		// 基类指针,根据子类类型执行虚函数Proceed()
-		CommonCallData* calldata=static_cast<CommonCallData*>(tag);
-		calldata->Proceed(ok);
+	while(cq->Next(&tag, &ok)){
+		// 标签指针,根据标签类型执行虚函数Proceed()
+		CompletionTag* completionTag=static_cast<CompletionTag*>(tag);
+		completionTag->Proceed(ok);
 	}
 }
 
 int main(int argc, char** argv) {
-  ServerImpl server;
+  ServerOptions options;
+  if(!parseOptions(argc, argv, options)){
+    std::cout<<"usage: "<<argv[0]<<" [-a address] [-w workers] [-m matchThreads] [-p]"
+    	<<" [-H highWatermark] [-L lowWatermark] [-s conflate|disconnect|cancel] [-d dedupWindow] [-r retransmitRing]"
+    	<<" [-j journalFile] [-g groupCommitMicros] [-A] [-k checkpointSeconds] [-c copy|fork]"<<std::endl;
+    return 1;
+  }
+  // 启用预写日志并从检查点和日志恢复, 必须在接受任何请求和启动撮合线程之前
+  if(!options.journal.empty()&&!TradingMarket::getInstance()->openJournal(options.journal, options.groupCommitMicros)){
+    return 1;
+  }
+  // 撮合产生的应答在订单簿所属的线程中投递, 各会话的应答序号与撮合顺序一致
+  TradingMarket::getInstance()->setReportSink(&CallDataOrderEntry::deliverReports);
+  // 默认等日志落盘后再发出应答; -A时先应答后落盘
+  if(!options.journal.empty()&&!options.ackBeforeDurable){
+    CommonCallData::durable_.start(TradingMarket::getInstance());
+  }
+  // 启用分片撮合模式, 绑定CPU时撮合线程排在工作线程之后
+  if(options.matchThreads>0){
+    TradingMarket::getInstance()->startMatchThreads(options.matchThreads, options.pin ? options.workers: -1);
+  }
+  // 定期写检查点, 重启时只需回放检查点之后的日志
+  if(!options.journal.empty()&&options.checkpointSeconds>0){
+    TradingMarket::getInstance()->startCheckpoints(options.checkpointSeconds, options.checkpointMode);
+  }
+  ServerImpl server(options);
   server.Run();
   return 0;
 }
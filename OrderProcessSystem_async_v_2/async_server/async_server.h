@@ -2,9 +2,11 @@
 #define SERVER_H
 #include <algorithm>
 #include <string>
+#include <cstring>
 #include <iostream>
 #include <unordered_map>
 #include <set>
+#include <random>
 #include <time.h>
 #include <mutex>
 #include <memory>
@@ -16,9 +18,14 @@
 #include <boost/type_traits.hpp>
 #include <cmath>
 #include "../helper/helper.h"
+#include "../helper/mpsc_queue.h"
+#include "../helper/completion_tag.h"
+#include "../helper/dedup_window.h"
 #include "../market/market.h"
+#include "../adapter/market_adapter.h"
 
 #include <grpc++/grpc++.h>
+#include <grpcpp/alarm.h>
 #include <grpc/support/log.h>
 #include "../proto/OrderProcessSystem.grpc.pb.h"
 #include "assert.h"
@@ -35,21 +42,61 @@ using grpc::Status;
 
 using OPS::NewOrderRequest;
 using OPS::CancelOrderRequest;
+using OPS::AmendOrderRequest;
+using OPS::OrderEntryRequest;
+using OPS::OrderEntryBatch;
+using OPS::LogonReport;
+using OPS::MassCancelRequest;
+using OPS::MassCancelReport;
 using OPS::QueryOrderRequest;
 using OPS::ExecutionReport;
+using OPS::ExecutionReportBatch;
 using OPS::OrderReport;
 using OPS::OrderService;
 
+// 每帧最多携带的执行结果数
+const size_t MAX_REPORT_BATCH=256;
+
+// 落盘闸门：启用日志时, 应答等到处理它时写入的日志记录全部落盘后才发出, 已确认的订单在崩溃后都能恢复
+// 各线程按处理顺序登记待发操作, 释放线程每次取出全部登记, 等待其中最大的seq落盘后按登记顺序执行
+// 未启动时登记的操作立即在调用线程执行(未启用日志, 或以-A选择先应答后落盘)
+class DurableGate{
+public:
+	DurableGate():market_(nullptr), stop_(false){}
+	~DurableGate(){stop();}
+	// 启动释放线程
+	void start(TradingMarket*);
+	// 停止释放线程, 已登记的操作落盘后执行
+	void stop();
+	bool enabled() const {return market_!=nullptr;}
+	// 登记待发操作: seq之前的日志记录全部落盘后执行
+	void hold(const uint64_t&, std::function<void()>&&);
+private:
+	// 释放线程主循环
+	void loop();
+	TradingMarket* market_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	// 已登记的<日志seq, 待发操作>, 按登记顺序排列
+	std::vector<std::pair<uint64_t, std::function<void()> > > held_;
+	bool stop_;
+	std::thread thread_;
+};
+
 // 基类
-class CommonCallData{
+class CommonCallData:public CompletionTag{
 public:
 	OrderService::AsyncService* service_;
 	ServerCompletionQueue* cq_;
 	ServerContext ctx_;
 	NewOrderRequest newOrderRequest_;
 	CancelOrderRequest cancelOrderRequest_;
+	AmendOrderRequest amendOrderRequest_;
+	MassCancelRequest massCancelRequest_;
 	QueryOrderRequest queryOrderRequest_;
 	ExecutionReport report_;
+	// 被撤订单所属的会话
+	SessionID owner_;
 	NewOrderRequest orderReport_;
 	// 交易市场
 	TradingMarket* tradingMarket_;
@@ -61,24 +108,188 @@ public:
 	explicit CommonCallData(OrderService::AsyncService*, ServerCompletionQueue*, TradingMarket*);
 	// 析构函数
 	virtual ~CommonCallData(){}
-	virtual void Proceed(bool=true)=0;
+	// 落盘闸门, 所有应答经它发出
+	static DurableGate durable_;
 };
+DurableGate CommonCallData::durable_;
 
-// 处理新订单类
-class CallDataPushNewOrder:public CommonCallData{
+class CallDataOrderEntry;
+
+// 慢消费者策略：会话出站队列积压超过高水位后的处理方式
+enum SlowConsumerPolicy{
+	// 合并: 同一订单连续的成交应答合并为一条(成交数量累加), 其他应答照常保留, 积压降到低水位后恢复逐条推送
+	SLOW_CONFLATE,
+	// 断开: 丢弃积压的应答并断开会话, 挂单保留
+	SLOW_DISCONNECT,
+	// 断开并撤单: 断开会话, 撤销该会话提交的全部挂单
+	SLOW_CANCEL
+};
+
+// 会话出站队列的水位(应答条数)与慢消费者策略, 以及会话的去重窗口与重传环大小
+struct SessionLimits{
+	uint32_t high=1u<<16;
+	uint32_t low=1u<<14;
+	SlowConsumerPolicy policy=SLOW_DISCONNECT;
+	// 每个会话记住最近多少个客户订单ID, 0表示不去重
+	uint32_t dedup=1u<<12;
+	// 每个会话保留最近多少条应答供续传时重发
+	uint32_t ring=1u<<12;
+};
+
+// 会话状态：与报单流分离, 报单流断开后保留, 客户端凭会话令牌重新登录即可续传
+struct SessionState{
+	// 投递、挂接与摘除互斥, 保证摘除后报单流对象不再被访问
+	std::mutex mutex;
+	// 挂接的报单流, 断开期间为nullptr
+	CallDataOrderEntry* stream=nullptr;
+	// 槽位被使用的次数
+	uint64_t generation=0;
+	// 会话令牌: 高位由服务端启动时的随机数和generation生成, 低16位为会话ID; 槽位回收或服务端重启后旧令牌失效; 0表示槽位空闲
+	uint64_t token=0;
+	// 下一条应答的序号
+	uint64_t nextSeq=1;
+	// 重传环: 第seq条应答存放在(seq-1)%ringSize处
+	std::vector<ExecutionReport> ring;
+	uint32_t ringSize=0;
+	// 以下只由挂接的报单流访问
+	// 最近下单的<客户订单ID, 订单ID>, 重发的订单直接回复原订单ID
+	std::unique_ptr<DedupWindow> dedup;
+	// 会话报单使用过的客户ID, 断开时撤单使用
+	std::set<uint64_t> clients;
+};
+
+// 会话表：报单会话登记在定长数组中, 会话ID即数组下标, 订单记录中保存会话ID, 应答路由只需一次数组访问
+// 投递时为应答编号并存入会话的重传环, 会话挂接着报单流时再转入其出站队列, 断开期间的应答在续传时重发
+// 报单流处于合并状态时应答先合并、暂不编号, 写出合并结果时再编号存入重传环, 重传环与客户端收到的应答一致
+// 报单流结束时摘除, 会话保留; 没有空闲槽位时才回收已断开且挂单全部离开订单簿的会话, 旧订单的应答不会被路由到新会话
+class SessionRegistry{
+public:
+	SessionRegistry();
+	// 建立新会话并挂接报单流, 没有空闲槽位时返回NO_SESSION
+	SessionID open(CallDataOrderEntry*, const SessionLimits&);
+	// 续传会话: 挂接报单流并重发序号大于lastSeq的应答, nextSeq返回重发的第一条应答的序号
+	// 令牌无效时返回NO_SESSION; 会话仍挂接着其他报单流(服务端尚未发现旧连接断开)时同样返回NO_SESSION, 并将busy置为true
+	SessionID resume(CallDataOrderEntry*, const uint64_t& token, const uint64_t& lastSeq, uint64_t& nextSeq, bool& busy);
+	// 摘除报单流, 返回后不会再有线程向该报单流投递应答
+	void detach(const SessionID&);
+	// 为应答编号并投递到会话, 槽位空闲时丢弃并返回false
+	bool deliver(const SessionID&, const ExecutionReport&);
+	// 为应答编号并存入重传环, 环满时覆盖最早的应答, 返回存入的应答(调用者持有槽位锁)
+	static ExecutionReport& record(SessionState&, const ExecutionReport&);
+	// 会话状态
+	SessionState& state(const SessionID& id){return states_[id];}
 private:
-	ServerAsyncReaderWriter<ExecutionReport, NewOrderRequest> responder_;
-	bool new_responder_created_;
-	bool writing_mode_;
-	uint32_t RequestsCounter_;
-	uint32_t ReportsCounter_;
-	std::vector<std::pair<uint64_t, ExecutionReport> > reports_;
-	static std::unordered_map<uint64_t, ServerAsyncReaderWriter<ExecutionReport, NewOrderRequest>*> orderID_responder_;
+	std::unique_ptr<SessionState[]> states_;
+	// 令牌的随机部分, 服务端每次启动不同
+	uint64_t salt_;
+	// 保护free_和detached_, 与会话状态的锁同时持有时先取本锁
+	std::mutex mutex_;
+	// 空闲槽位
+	std::vector<SessionID> free_;
+	// 已断开、可续传的会话, 按断开的先后排列
+	std::vector<SessionID> detached_;
+};
+
+// 处理报单流类：报单流以第一帧中的登录请求建立或续传一个会话, 流上的新订单、撤单和改单按到达顺序逐个处理
+// 发往会话的应答(包括其他会话撮合产生的成交)先进入出站队列, 由报单流自己的状态机逐个写出,
+// 任一时刻只有一个写操作在进行, 写操作进行期间积累的应答在写完成后一次取出, 合并为一帧写出
+// 流结束后从会话摘除, 读、写和唤醒都完成后释放
+// 出站队列积压超过高水位时按慢消费者策略处理, 入队永远不会阻塞撮合线程
+class CallDataOrderEntry:public CommonCallData{
+private:
+	ServerAsyncReaderWriter<ExecutionReportBatch, OrderEntryBatch> responder_;
+	// 读到的一帧请求
+	OrderEntryBatch entryBatch_;
+	// 读、写、唤醒、结束各用一个标签, 可以同时进行
+	MemberTag<CallDataOrderEntry> readTag_;
+	MemberTag<CallDataOrderEntry> writeTag_;
+	MemberTag<CallDataOrderEntry> alarmTag_;
+	MemberTag<CallDataOrderEntry> finishTag_;
+	MemberTag<CallDataOrderEntry> doneTag_;
+	// 会话ID, 登录前为NO_SESSION
+	SessionID session_;
+	// 会话状态, 登录后有效
+	SessionState* state_;
+	// 登录应答, 随第一帧写出
+	LogonReport logonReport_;
+	bool logonPending_;
+	// 出站队列, 任意线程入队, 只由本会话所在的工作线程出队
+	MpscQueue<ExecutionReport> outbox_;
+	// 已从出站队列取出、等待写出的应答
+	std::deque<ExecutionReport> pending_;
+	// 正在写出的一帧应答, 写操作完成前必须保持有效
+	ExecutionReportBatch writing_batch_;
+	// 已入队尚未写出的应答数
+	std::atomic<uint32_t> queued_;
+	// 为true时有写操作在进行或已安排唤醒, 此时入队者不再唤醒会话
+	std::atomic<bool> writing_;
+	// 合并状态: 新的应答不编号, 进入conflated_而不是出站队列
+	std::atomic<bool> conflating_;
+	// 合并的应答, 按到达顺序排列, 由会话的槽位锁保护
+	std::vector<ExecutionReport> conflated_;
+	// 订单ID -> 该订单最近一条成交应答在conflated_中的下标, 其后再无该订单的其他应答时后续成交并入这一条
+	std::unordered_map<uint64_t, size_t> conflatedIndex_;
+	// 因慢消费被断开
+	std::atomic<bool> slow_;
+	// 写失败或流结束后不再接收应答
+	std::atomic<bool> closed_;
+	// 以下状态只由本会话所在的工作线程访问
+	// 有读操作在进行
+	bool reading_;
+	// 有结束操作在进行
+	bool finishing_;
+	// 流已结束并已从会话表注销
+	bool done_;
+	// 用于从其他线程唤醒本会话所在的完成队列
+	grpc::Alarm alarm_;
+	std::vector<std::pair<SessionID, ExecutionReport> > reports_;
+	// 会话表
+	static SessionRegistry registry_;
+	// 出站队列水位、慢消费者策略、去重窗口与重传环大小
+	static SessionLimits limits_;
+	// 为合并的应答编号并存入重传环, 结束合并状态; send为true时排在已编号的应答之后移入待写队列(仅本会话所在的工作线程)
+	void flushConflated(const bool& send);
+	// 唤醒会话
+	void wake();
+	// 读完成
+	void OnRead(bool);
+	// 写完成
+	void OnWrite(bool);
+	// 被其他线程唤醒
+	void OnAlarm(bool);
+	// 结束完成
+	void OnFinish(bool);
+	// 流结束(客户端断开或调用完成)
+	void OnDone(bool);
+	// 按第一帧中的登录请求建立或续传会话, 失败时结束报单流并返回false
+	bool logon();
+	// 处理一个报单流请求
+	void processEntry(const OrderEntryRequest&);
+	// 经落盘闸门将只发给请求方的应答投递到本会话, 排在本次处理已登记的应答之后
+	void reply(const ExecutionReport&);
+	// 写出下一帧应答, 没有待写应答时结束写状态(仅本会话所在的工作线程)
+	void WriteNext();
+	// 流已结束且没有进行中的操作时释放会话
+	void TryRelease();
 public:
-	CallDataPushNewOrder(OrderService::AsyncService*, ServerCompletionQueue*, TradingMarket*);
+	CallDataOrderEntry(OrderService::AsyncService*, ServerCompletionQueue*, TradingMarket*);
+	// 报单流建立
 	virtual void Proceed(bool =true) override;
+	// 已编号的应答入队(任意线程)
+	void enqueue(const ExecutionReport&);
+	// 合并一条尚未编号的应答(持槽位锁调用), 未进入合并状态时返回false, 由调用者照常编号入队
+	bool conflate(const ExecutionReport&);
+	// 将应答投递到会话, 会话已关闭时丢弃
+	static void deliver(const SessionID& session, const ExecutionReport& report){
+		if(session!=NO_SESSION) registry_.deliver(session, report);
+	}
+	// 撮合核心的应答回调: 在订单簿所属的线程中转换应答并登记到落盘闸门, 各会话的应答序号与撮合顺序一致
+	static void deliverReports(const std::pair<SessionID, Execution>*, const size_t&, const uint64_t&);
+	// 设置出站队列水位、慢消费者策略、去重窗口与重传环大小, 需在服务启动前调用
+	static void setLimits(const SessionLimits& limits){limits_=limits;}
 };
-std::unordered_map<uint64_t, ServerAsyncReaderWriter<ExecutionReport, NewOrderRequest>*> CallDataPushNewOrder::orderID_responder_;
+SessionRegistry CallDataOrderEntry::registry_;
+SessionLimits CallDataOrderEntry::limits_;
 
 // 处理撤销订单
 class CallDataPushCancelOrder:public CommonCallData{
@@ -90,6 +301,32 @@ public:
 	virtual void Proceed(bool = true) override;
 };
 
+// 处理批量撤单
+class CallDataMassCancel:public CommonCallData{
+private:
+	ServerAsyncResponseWriter<MassCancelReport> responder_;
+	MassCancelReport massCancelReport_;
+public:
+	CallDataMassCancel(OrderService::AsyncService*, ServerCompletionQueue*, TradingMarket*);
+	virtual void Proceed(bool = true) override;
+};
+
+// 处理改单
+class CallDataAmendOrder:public CommonCallData{
+private:
+	ServerAsyncWriter<ExecutionReport> responder_;
+	bool new_responder_created_;
+	uint32_t reportsCounter_;
+	std::vector<std::pair<SessionID, ExecutionReport> > reports_;
+	// 写入本流的应答
+	std::vector<ExecutionReport> ownReports_;
+	// 写出下一条应答, 全部写完后结束
+	void WriteNext();
+public:
+	CallDataAmendOrder(OrderService::AsyncService*, ServerCompletionQueue*, TradingMarket*);
+	virtual void Proceed(bool =true) override;
+};
+
 // 处理查询订单
 class CallDataPushQueryOrder:public CommonCallData{
 private:
@@ -102,23 +339,53 @@ public:
 	virtual void Proceed(bool =true) override;
 };
 
+// 服务端启动参数
+struct ServerOptions{
+	// 监听地址
+	std::string address="0.0.0.0:50010";
+	// 工作线程数, 每个工作线程独占一个完成队列
+	int workers=std::max(1u, std::thread::hardware_concurrency());
+	// 撮合线程数, 0表示加锁模式
+	int matchThreads=0;
+	// 是否将工作线程和撮合线程绑定到CPU
+	bool pin=false;
+	// 会话出站队列水位、慢消费者策略、去重窗口与重传环大小
+	SessionLimits limits;
+	// 预写日志文件, 为空时不记录日志
+	std::string journal;
+	// 日志组提交间隔(微秒)
+	uint32_t groupCommitMicros=DEFAULT_GROUP_COMMIT_MICROS;
+	// 检查点间隔(秒), 0表示不写检查点; 只在启用日志时生效
+	int checkpointSeconds=60;
+	// 检查点方式
+	CheckpointMode checkpointMode=CHECKPOINT_COPY;
+	// 先应答后落盘: 应答不等待日志落盘, 进程崩溃时可能丢失最近一个组提交间隔内已确认的订单
+	bool ackBeforeDurable=false;
+};
+
+// 解析命令行参数, 参数非法时返回false
+bool parseOptions(int, char**, ServerOptions&);
+
 // 服务端类
 class ServerImpl final{
 public:
-	ServerImpl(){
+	explicit ServerImpl(const ServerOptions& options):options_(options){
 		tradingMarket_=TradingMarket::getInstance();
 	}
 	~ServerImpl(){
 		server_->Shutdown();
-		cq_->Shutdown();	
+		for(auto& cq:cqs_) cq->Shutdown();
 		delete tradingMarket_;
 	}
 	void Run();
 private:
-	std::unique_ptr<ServerCompletionQueue> cq_;
+	ServerOptions options_;
+	// 完成队列, 每个工作线程一个
+	std::vector<std::unique_ptr<ServerCompletionQueue> > cqs_;
  	OrderService::AsyncService service_;
   	std::unique_ptr<Server> server_;
 	TradingMarket* tradingMarket_;
-	void HandleRpcs();
+	// 工作线程主循环: 在自己的完成队列上注册请求处理并处理事件
+	void HandleRpcs(ServerCompletionQueue*);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef COMPLETION_TAG_H
+#define COMPLETION_TAG_H
+
+// 完成队列事件标签：工作线程取出事件后调用Proceed
+class CompletionTag{
+public:
+	virtual ~CompletionTag(){}
+	virtual void Proceed(bool=true)=0;
+};
+
+// 成员函数标签：同一个调用同时有多个异步操作在进行时, 每种操作使用独立的标签
+template<typename T>
+class MemberTag:public CompletionTag{
+public:
+	typedef void (T::*Handler)(bool);
+	MemberTag(T* owner, Handler handler):owner_(owner), handler_(handler){}
+	virtual void Proceed(bool ok=true) override {(owner_->*handler_)(ok);}
+private:
+	T* owner_;
+	Handler handler_;
+};
+
+#endif
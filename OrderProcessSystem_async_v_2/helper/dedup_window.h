@@ -0,0 +1,90 @@
+#ifndef DEDUP_WINDOW_H
+#define DEDUP_WINDOW_H
+
+#include <stdint.h>
+#include <memory>
+
+// 去重窗口：记住最近插入的capacity个键及其值, 更早的键按插入顺序淘汰, 占用的内存固定
+// 环形缓冲区记录插入顺序; 开放寻址hash表(线性探测)负责查找, 删除时把后续元素前移, 不留墓碑
+// 键0表示空槽, 不能插入; 非线程安全
+class DedupWindow{
+public:
+	explicit DedupWindow(const uint32_t& capacity):capacity_(capacity), head_(0), size_(0){
+		// hash表大小取不小于2倍容量的2的幂, 装载因子不超过0.5
+		uint32_t buckets=2;
+		shift_=63;
+		while(buckets<2*(uint64_t)capacity_){
+			buckets<<=1;
+			--shift_;
+		}
+		mask_=buckets-1;
+		ring_.reset(new uint64_t[capacity_]);
+		table_.reset(new Entry[buckets]());
+	}
+	DedupWindow(const DedupWindow&)=delete;
+	DedupWindow& operator=(const DedupWindow&)=delete;
+
+	// 查找键, 存在时写出对应的值
+	bool find(const uint64_t& key, uint64_t& value) const {
+		for(uint32_t i=bucket(key);table_[i].key!=0;i=(i+1)&mask_){
+			if(table_[i].key==key){
+				value=table_[i].value;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// 插入不在窗口中的键, 窗口已满时先淘汰最早插入的键
+	void insert(const uint64_t& key, const uint64_t& value){
+		if(capacity_==0) return;
+		if(size_==capacity_){
+			erase(ring_[head_]);
+			ring_[head_]=key;
+			head_=(head_+1)%capacity_;
+		}else{
+			ring_[(head_+size_)%capacity_]=key;
+			++size_;
+		}
+		uint32_t i=bucket(key);
+		while(table_[i].key!=0) i=(i+1)&mask_;
+		table_[i].key=key;
+		table_[i].value=value;
+	}
+private:
+	struct Entry{
+		uint64_t key;
+		uint64_t value;
+	};
+	// 斐波那契散列, 取乘积的高位
+	uint32_t bucket(const uint64_t& key) const {
+		return (uint32_t)((key*0x9E3779B97F4A7C15ull)>>shift_);
+	}
+	// 删除键: 之后同一探测链上的元素前移填补空槽, 查找时不会提前遇到空槽
+	void erase(const uint64_t& key){
+		uint32_t i=bucket(key);
+		while(table_[i].key!=key){
+			if(table_[i].key==0) return;
+			i=(i+1)&mask_;
+		}
+		for(uint32_t j=(i+1)&mask_;table_[j].key!=0;j=(j+1)&mask_){
+			uint32_t home=bucket(table_[j].key);
+			// home在(i, j]区间(环形)内时, 元素j留在原处仍能被找到
+			bool stay=i<j ? (i<home&&home<=j): (i<home||home<=j);
+			if(stay) continue;
+			table_[i]=table_[j];
+			i=j;
+		}
+		table_[i].key=0;
+	}
+	uint32_t capacity_;
+	// 最早插入的键在环形缓冲区中的下标
+	uint32_t head_;
+	uint32_t size_;
+	uint32_t mask_;
+	int shift_;
+	std::unique_ptr<uint64_t[]> ring_;
+	std::unique_ptr<Entry[]> table_;
+};
+
+#endif
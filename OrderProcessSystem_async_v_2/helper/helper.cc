@@ -6,7 +6,17 @@
 std::string getTime(){
 	std::time_t cur;
 	time(&cur);
-	std::string time_str=ctime(&cur);
+	// ctime_r可重入, 多个线程同时调用不会互相覆盖
+	char buf[32];
+	std::string time_str=ctime_r(&cur, buf);
+	return time_str;
+}
+
+// 将时间戳转换为时间字符串
+std::string getTime(const int64_t& timestamp){
+	std::time_t cur=timestamp;
+	char buf[32];
+	std::string time_str=ctime_r(&cur, buf);
 	return time_str;
 }
 
@@ -31,6 +41,15 @@ void printRequest(const CancelOrderRequest& request){
 	std::cout<<std::endl;
 }
 
+void printRequest(const AmendOrderRequest& request){
+	std::cout<<"改单请求: "<<std::endl;
+	std::cout<<"	订单ID: "<<request.orderid()<<", "<<std::endl;
+	std::cout<<"	订单数量: "<<request.orderqty()<<", "<<std::endl;
+	std::cout<<"	订单价格: "<<request.price()<<", "<<std::endl;
+	std::cout<<"	改单时间:  "<<request.time();
+	std::cout<<std::endl;
+}
+
 void printReport(const ExecutionReport& report){
 	std::cout<<"执行结果: "<<std::endl;
 	if(report.stat()==ExecutionReport::ORDER_ACCEPT){
@@ -41,6 +60,12 @@ void printReport(const ExecutionReport& report){
 		std::cout<<"	[交易成功 FILL]"<<", "<<std::endl;
 	}else if(report.stat()==ExecutionReport::CANCELED){
 		std::cout<<"	[订单取消 CANCELED]"<<", "<<std::endl;
+	}else if(report.stat()==ExecutionReport::REPLACED){
+		std::cout<<"	[改单成功 REPLACED]"<<", "<<std::endl;
+	}else if(report.stat()==ExecutionReport::REPLACE_REJECT){
+		std::cout<<"	[改单拒绝 REPLACE_REJECT]"<<", "<<std::endl;
+	}else if(report.stat()==ExecutionReport::ORDER_DUPLICATE){
+		std::cout<<"	[重复报单 ORDER_DUPLICATE]"<<", "<<std::endl;
 	}else{
 		std::cout<<"	[撤单拒绝 CANCEL_REJECT]"<<", "<<std::endl;
 	}
@@ -50,6 +75,7 @@ void printReport(const ExecutionReport& report){
 	else{
 		std::cout<<"	客户ID: "<<report.clientid()<<", "<<std::endl;
 		std::cout<<"	订单ID: "<<report.orderid()<<", "<<std::endl;
+		if(report.clordid()>0) std::cout<<"	客户订单ID: "<<report.clordid()<<", "<<std::endl;
 		std::cout<<"	股票ID: "<<report.stockid()<<", "<<std::endl;
 		std::cout<<"	订单数量: "<<report.orderqty()<<", "<<std::endl;
 		std::cout<<"	订单价格: "<<report.orderprice()<<", "<<std::endl;
@@ -76,23 +102,18 @@ void printReport(const OrderReport& report){
 	std::cout<<std::endl;
 }
 
-// 判断订单的合法性
-bool checkRequest(const NewOrderRequest& request, std::string& errorMessage){
-	if(request.clientid()<=0){
-		errorMessage="Error: ClientID is illegal!";
-	}else if(request.stockid().size()<=0){
-		errorMessage="Error: StockID is illegal!";
-	}else if(request.direction()!=NewOrderRequest::SELL&&request.direction()!=NewOrderRequest::BUY){
-		errorMessage="Error: Order direction is illegal!";
-	}else if(request.orderqty()<=0){
-		errorMessage="Error: Order quantity is illegal!";
-	}else if(request.price()<=0){
-		errorMessage="Error: Order price is illegal!";
-	}else if(request.ordertype()!=NewOrderRequest::LIMIT&&request.ordertype()!=NewOrderRequest::MARKET){
-		errorMessage="Error: Order type is illegal!";
+void printReport(const MassCancelReport& report){
+	std::cout<<"批量撤单结果: "<<std::endl;
+	if(report.errormessage().size()>0){
+		std::cout<<"	错误信息: "<<report.errormessage()<<", "<<std::endl;
 	}
-	if(errorMessage.size()>0) return false;
-	return true;
+	else{
+		std::cout<<"	客户ID: "<<report.clientid()<<", "<<std::endl;
+		std::cout<<"	撤销订单数: "<<report.canceledorders()<<", "<<std::endl;
+		std::cout<<"	撤销数量: "<<report.canceledqty()<<", "<<std::endl;
+		std::cout<<"	撤单时间: "<<report.time();
+	}
+	std::cout<<std::endl;
 }
 
 // 初始化应答
@@ -103,16 +124,20 @@ void initReport(ExecutionReport& report, const NewOrderRequest& request){
 	report.set_clientid(request.clientid());
 	// 订单ID
 	report.set_orderid(0);
+	// 客户订单ID
+	report.set_clordid(request.clordid());
 	// 股票代码
 	report.set_stockid(request.stockid());
 	// 订单总量
 	report.set_orderqty(request.orderqty());
 	// 订单价格
 	report.set_orderprice(request.price());
+	report.set_orderpriceticks(request.priceticks());
 	// 订单成交数量
 	report.set_fillqty(0);
 	// 订单成交价格
 	report.set_fillprice(0);
+	report.set_fillpriceticks(0);
 	// 剩余待成交数量
 	report.set_leaveqty(request.orderqty());
 	// 错误信息
@@ -121,20 +146,6 @@ void initReport(ExecutionReport& report, const NewOrderRequest& request){
 	report.set_time("");
 }
 // 初始化应答
-void initReport(ExecutionReport& report, const CancelOrderRequest& request){
-	report.set_stat(ExecutionReport::CANCEL_REJECT);
-	report.set_clientid(0);
-	report.set_orderid(request.orderid());
-	report.set_stockid("");
-	report.set_orderqty(0);
-	report.set_orderprice(0);
-	report.set_fillqty(0);
-	report.set_fillprice(0);
-	report.set_leaveqty(0);
-	report.set_errormessage("");
-	report.set_time("");
-}
-// 初始化应答
 void initReport(OrderReport& report, const NewOrderRequest& request, const uint64_t& orderID){
 	report.set_orderid(orderID);
 	if(request.ordertype()==NewOrderRequest::LIMIT) report.set_ordertype(OrderReport::LIMIT);
@@ -147,6 +158,7 @@ void initReport(OrderReport& report, const NewOrderRequest& request, const uint6
 	report.set_stockid(request.stockid());
 	report.set_orderqty(request.orderqty());
 	report.set_price(request.price());
+	report.set_priceticks(request.priceticks());
 	report.set_time(request.time());
 }
 
@@ -4,21 +4,25 @@
 #include <string>
 #include <iostream>
 #include <time.h>
-#include "../proto/OrderProcessSystem.grpc.pb.h"
+#include <thread>
+#include "../proto/OrderProcessSystem.pb.h"
 
 using OPS::NewOrderRequest;
 using OPS::CancelOrderRequest;
+using OPS::AmendOrderRequest;
+using OPS::MassCancelRequest;
+using OPS::MassCancelReport;
 using OPS::ExecutionReport;
 using OPS::OrderReport;
-using OPS::OrderService;
 
 void printRequest(const NewOrderRequest&);
 void printRequest(const CancelOrderRequest&);
+void printRequest(const AmendOrderRequest&);
 void printReport(const ExecutionReport&);
 void printReport(const OrderReport&);
+void printReport(const MassCancelReport&);
 std::string getTime();
-bool checkRequest(const NewOrderRequest&, std::string&);
+std::string getTime(const int64_t&);
 void initReport(ExecutionReport&, const NewOrderRequest&);
-void initReport(ExecutionReport&, const CancelOrderRequest&);
 void initReport(OrderReport&, const NewOrderRequest&, const uint64_t&);
 #endif 
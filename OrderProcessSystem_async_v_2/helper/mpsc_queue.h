@@ -0,0 +1,65 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <deque>
+#include <utility>
+
+// 无界无锁队列：支持多生产者单消费者
+// 生产者以CAS压入链表头部; 消费者一次取走整条链表并反转, 得到按入队顺序排列的全部元素
+template<typename T>
+class MpscQueue{
+public:
+	MpscQueue():head_(nullptr){}
+	MpscQueue(const MpscQueue&)=delete;
+	MpscQueue& operator=(const MpscQueue&)=delete;
+	~MpscQueue(){
+		Node* node=head_.load(std::memory_order_relaxed);
+		while(node!=nullptr){
+			Node* next=node->next;
+			delete node;
+			node=next;
+		}
+	}
+
+	// 入队(任意线程)
+	void push(T data){
+		Node* node=new Node(std::move(data));
+		node->next=head_.load(std::memory_order_relaxed);
+		while(!head_.compare_exchange_weak(node->next, node, std::memory_order_seq_cst, std::memory_order_relaxed));
+	}
+
+	// 取出队列中的全部元素, 按入队顺序追加到out末尾, 返回取出的个数(仅消费者线程)
+	size_t popAll(std::deque<T>& out){
+		Node* node=head_.exchange(nullptr, std::memory_order_seq_cst);
+		// 反转链表, 恢复入队顺序
+		Node* reversed=nullptr;
+		while(node!=nullptr){
+			Node* next=node->next;
+			node->next=reversed;
+			reversed=node;
+			node=next;
+		}
+		size_t count=0;
+		while(reversed!=nullptr){
+			Node* next=reversed->next;
+			out.push_back(std::move(reversed->data));
+			delete reversed;
+			reversed=next;
+			++count;
+		}
+		return count;
+	}
+
+	bool empty() const {return head_.load(std::memory_order_seq_cst)==nullptr;}
+private:
+	struct Node{
+		explicit Node(T&& value):data(std::move(value)), next(nullptr){}
+		T data;
+		Node* next;
+	};
+	std::atomic<Node*> head_;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+// 有界无锁环形队列：支持多生产者多消费者, 容量向上取整为2的幂
+// 每个槽位带序号, 生产者与消费者只通过CAS竞争下标, 不使用互斥锁
+template<typename T>
+class RingBuffer{
+public:
+	explicit RingBuffer(size_t capacity){
+		size_t size=2;
+		while(size<capacity) size<<=1;
+		mask_=size-1;
+		cells_.reset(new Cell[size]);
+		for(size_t i=0;i<size;i++) cells_[i].seq.store(i, std::memory_order_relaxed);
+		head_.store(0, std::memory_order_relaxed);
+		tail_.store(0, std::memory_order_relaxed);
+	}
+	RingBuffer(const RingBuffer&)=delete;
+	RingBuffer& operator=(const RingBuffer&)=delete;
+
+	// 入队, 队列已满时返回false
+	bool push(const T& data){
+		size_t pos=head_.load(std::memory_order_relaxed);
+		Cell* cell;
+		for(;;){
+			cell=&cells_[pos&mask_];
+			size_t seq=cell->seq.load(std::memory_order_acquire);
+			intptr_t diff=(intptr_t)seq-(intptr_t)pos;
+			if(diff==0){
+				if(head_.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+			}else if(diff<0){
+				return false;
+			}else{
+				pos=head_.load(std::memory_order_relaxed);
+			}
+		}
+		cell->data=data;
+		cell->seq.store(pos+1, std::memory_order_release);
+		return true;
+	}
+
+	// 出队, 队列为空时返回false
+	bool pop(T& data){
+		size_t pos=tail_.load(std::memory_order_relaxed);
+		Cell* cell;
+		for(;;){
+			cell=&cells_[pos&mask_];
+			size_t seq=cell->seq.load(std::memory_order_acquire);
+			intptr_t diff=(intptr_t)seq-(intptr_t)(pos+1);
+			if(diff==0){
+				if(tail_.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+			}else if(diff<0){
+				return false;
+			}else{
+				pos=tail_.load(std::memory_order_relaxed);
+			}
+		}
+		data=cell->data;
+		cell->seq.store(pos+mask_+1, std::memory_order_release);
+		return true;
+	}
+
+	// 队列中的元素个数(近似值)
+	size_t size() const {
+		size_t head=head_.load(std::memory_order_acquire);
+		size_t tail=tail_.load(std::memory_order_acquire);
+		return head>tail ? head-tail: 0;
+	}
+	bool empty() const {return size()==0;}
+	// 队列容量
+	size_t capacity() const {return mask_+1;}
+private:
+	struct Cell{
+		std::atomic<size_t> seq;
+		T data;
+	};
+	std::unique_ptr<Cell[]> cells_;
+	size_t mask_;
+	// 生产者与消费者下标分别独占缓存行, 避免伪共享
+	alignas(64) std::atomic<size_t> head_;
+	alignas(64) std::atomic<size_t> tail_;
+};
+
+#endif
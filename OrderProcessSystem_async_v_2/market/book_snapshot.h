@@ -0,0 +1,44 @@
+#ifndef BOOK_SNAPSHOT_H
+#define BOOK_SNAPSHOT_H
+
+#include <stdint.h>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "order_pool.h"
+
+// 每个快照页包含的订单序号个数(2的幂)
+const int SNAPSHOT_PAGE_BITS=10;
+
+// 订单视图：快照中的只读订单行
+struct OrderView{
+	uint64_t orderID;
+	uint64_t clientID;
+	int64_t price;
+	uint32_t time;
+	uint32_t leaveQty;
+	OrderSide side;
+	OrderKind kind;
+};
+
+// 客户索引项: <客户ID, 订单在快照页中的下标>
+typedef std::pair<uint64_t, uint32_t> ClientRow;
+
+// 快照页：订单序号在同一区间内的挂单, 按订单ID排序, 发布后不再修改
+struct SnapshotPage{
+	std::vector<OrderView> orders;
+	// 客户索引: 按客户ID排序, 同一客户的订单按订单ID排序, 按客户查询时只访问该客户的订单
+	std::vector<ClientRow> clients;
+};
+
+// 订单簿快照：写时复制, 只重建发生变化的页, 未变化的页在新旧快照之间共享
+// 快照发布后只读, 读者持有shared_ptr即可遍历, 不需要任何锁
+struct BookSnapshot{
+	// 生成快照时订单簿的版本号
+	uint64_t version;
+	// pages[i]对应第firstPage+i页, 没有挂单的页为nullptr
+	uint64_t firstPage;
+	std::vector<std::shared_ptr<const SnapshotPage> > pages;
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef CHECKPOINT_CC
+#define CHECKPOINT_CC
+#include "checkpoint.h"
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+
+// 股票代码补齐到8字节后的长度
+static size_t padded(const size_t& size){
+	return (size+7)&~(size_t)7;
+}
+
+// 按8字节分组的FNV-1a校验和, 文件各部分都补齐到8字节
+static uint64_t checksum(uint64_t hash, const char* data, const size_t& size){
+	for(size_t i=0;i+8<=size;i+=8){
+		uint64_t word;
+		memcpy(&word, data+i, 8);
+		hash^=word;
+		hash*=1099511628211ull;
+	}
+	return hash;
+}
+static const uint64_t CHECKSUM_SEED=14695981039346656037ull;
+
+// 生成订单簿的映像
+void captureBook(OrderBook& book, const uint64_t& journalSeq, BookImage& image){
+	auto& pool=book.pool();
+	image.stockID=book.stockID();
+	image.book.symbol=book.symbol();
+	image.book.stockLen=image.stockID.size();
+	image.book.tickSize=book.tickSize();
+	image.book.orderSeq=book.orderSeq();
+	image.book.journalSeq=journalSeq;
+	image.orders.clear();
+	image.orders.reserve(pool.size());
+	auto copyLevel=[&](const PriceLevel& level){
+		for(auto handle=level.head; handle!=NIL_HANDLE;){
+			auto& order=pool.get(handle);
+			image.orders.push_back(CheckpointOrder{order.orderID, order.clientID, order.price, pool.clOrdID(handle),
+					order.time, order.orderQty, order.leaveQty, order.side, order.kind, 0});
+			handle=order.next;
+		}
+	};
+	for(auto& lv:book.asks()) copyLevel(lv.second);
+	for(auto& lv:book.bids()) copyLevel(lv.second);
+	image.book.orders=image.orders.size();
+}
+
+// 创建订单记录并挂到档位队尾
+OrderHandle restoreOrder(OrderBook& book, const CheckpointOrder& src){
+	auto& pool=book.pool();
+	auto handle=pool.allocate();
+	auto& order=pool.get(handle);
+	order.orderID=src.orderID;
+	order.clientID=src.clientID;
+	order.price=src.price;
+	order.time=src.time;
+	order.orderQty=src.orderQty;
+	order.leaveQty=src.leaveQty;
+	order.side=src.side;
+	order.kind=src.kind;
+	// 会话不跨越重启, 恢复的订单不属于任何会话
+	order.session=NO_SESSION;
+	pool.clOrdID(handle)=src.clOrdID;
+	order.level=nullptr;
+	order.prev=order.next=NIL_HANDLE;
+	order.clientPrev=order.clientNext=NIL_HANDLE;
+	if(order.side==SIDE_SELL){
+		book.addAsk(order.price, handle);
+	}else{
+		book.addBid(order.price, handle);
+	}
+	return handle;
+}
+
+// 把映像中的挂单批量挂入空订单簿
+void restoreBook(OrderBook& book, const CheckpointBook& header, const CheckpointOrder* orders){
+	auto& pool=book.pool();
+	book.restoreSeq(header.orderSeq);
+	std::vector<OrderHandle> handles(header.orders);
+	// 映像中的挂单已按档位内的先后顺序排列, 依次挂到队尾即可恢复时间优先
+	for(uint64_t i=0;i<header.orders;i++){
+		handles[i]=restoreOrder(book, orders[i]);
+	}
+	// 挂单登记要求订单ID递增
+	std::sort(handles.begin(), handles.end(), [&pool](const OrderHandle& a, const OrderHandle& b){
+		return pool.get(a).orderID<pool.get(b).orderID;
+	});
+	for(auto handle:handles) book.indexOrder(handle);
+}
+
+CheckpointWriter::~CheckpointWriter(){
+	if(file_!=nullptr) fclose(file_);
+}
+
+// 创建文件, 头部先占位
+bool CheckpointWriter::open(const std::string& path, const uint64_t& fromSeq){
+	file_=fopen(path.c_str(), "wb");
+	if(file_==nullptr) return false;
+	memset(&header_, 0, sizeof(header_));
+	header_.magic=CHECKPOINT_MAGIC;
+	header_.version=CHECKPOINT_VERSION;
+	header_.size=sizeof(header_);
+	header_.minSeq=fromSeq;
+	header_.maxSeq=fromSeq;
+	hash_=CHECKSUM_SEED;
+	ok_=fwrite(&header_, sizeof(header_), 1, file_)==1;
+	return ok_;
+}
+
+// 追加一个订单簿
+void CheckpointWriter::add(const BookImage& image){
+	std::string stock(image.stockID);
+	stock.resize(padded(stock.size()), '\0');
+	ok_=ok_&&fwrite(&image.book, sizeof(CheckpointBook), 1, file_)==1;
+	ok_=ok_&&fwrite(stock.data(), 1, stock.size(), file_)==stock.size();
+	ok_=ok_&&fwrite(image.orders.data(), sizeof(CheckpointOrder), image.orders.size(), file_)==image.orders.size();
+	hash_=checksum(hash_, (const char*)&image.book, sizeof(CheckpointBook));
+	hash_=checksum(hash_, stock.data(), stock.size());
+	hash_=checksum(hash_, (const char*)image.orders.data(), image.orders.size()*sizeof(CheckpointOrder));
+	header_.books++;
+	header_.size+=sizeof(CheckpointBook)+stock.size()+image.orders.size()*sizeof(CheckpointOrder);
+	header_.maxSeq=std::max(header_.maxSeq, image.book.journalSeq);
+}
+
+// 回填头部并同步
+bool CheckpointWriter::finish(){
+	header_.checksum=checksum(hash_, (const char*)&header_, offsetof(CheckpointHeader, checksum));
+	ok_=ok_&&fseek(file_, 0, SEEK_SET)==0;
+	ok_=ok_&&fwrite(&header_, sizeof(header_), 1, file_)==1;
+	ok_=ok_&&fflush(file_)==0&&fsync(fileno(file_))==0;
+	ok_=fclose(file_)==0&&ok_;
+	file_=nullptr;
+	return ok_;
+}
+
+// 写检查点
+bool writeCheckpoint(const std::string& path, const std::vector<BookImage>& images, const uint64_t& fromSeq){
+	// 先写临时文件, 同步后再改名
+	std::string tmp=path+".tmp";
+	CheckpointWriter writer;
+	bool ok=writer.open(tmp, fromSeq);
+	if(ok){
+		for(auto& image:images) writer.add(image);
+		ok=writer.finish();
+	}
+	if(!ok||rename(tmp.c_str(), path.c_str())!=0){
+		std::cerr<<"checkpoint: cannot write "<<path<<": "<<strerror(errno)<<std::endl;
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+CheckpointFile::~CheckpointFile(){
+	if(data_!=nullptr) munmap((void*)data_, size_);
+}
+
+// 映射并校验文件
+bool CheckpointFile::open(const std::string& path, std::string& error){
+	int fd=::open(path.c_str(), O_RDONLY);
+	if(fd<0){
+		if(errno!=ENOENT) error=strerror(errno);
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd, &st)!=0||(size_t)st.st_size<sizeof(CheckpointHeader)){
+		error="file too short";
+		::close(fd);
+		return false;
+	}
+	size_=st.st_size;
+	void* data=mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(data==MAP_FAILED){
+		error=strerror(errno);
+		return false;
+	}
+	data_=(const char*)data;
+	// 顺序读取, 提示内核预读
+	madvise(data, size_, MADV_SEQUENTIAL);
+	auto& h=header();
+	if(h.magic!=CHECKPOINT_MAGIC||h.version!=CHECKPOINT_VERSION||h.size!=size_){
+		error="bad header";
+		return false;
+	}
+	uint64_t hash=checksum(CHECKSUM_SEED, data_+sizeof(CheckpointHeader), size_-sizeof(CheckpointHeader));
+	hash=checksum(hash, data_, offsetof(CheckpointHeader, checksum));
+	if(hash!=h.checksum){
+		error="checksum mismatch";
+		return false;
+	}
+	offset_=sizeof(CheckpointHeader);
+	return true;
+}
+
+// 取出下一个订单簿
+bool CheckpointFile::next(const CheckpointBook*& book, std::string& stockID, const CheckpointOrder*& orders){
+	if(offset_+sizeof(CheckpointBook)>size_) return false;
+	book=(const CheckpointBook*)(data_+offset_);
+	offset_+=sizeof(CheckpointBook);
+	stockID.assign(data_+offset_, book->stockLen);
+	offset_+=padded(book->stockLen);
+	orders=(const CheckpointOrder*)(data_+offset_);
+	offset_+=book->orders*sizeof(CheckpointOrder);
+	return offset_<=size_;
+}
+#endif
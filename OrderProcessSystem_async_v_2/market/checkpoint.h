@@ -0,0 +1,109 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "order_book.h"
+
+// 检查点文件：全部订单簿及其挂单的紧凑二进制映像, 启动时mmap后直接批量重建订单簿
+// 文件布局: CheckpointHeader, 之后每个订单簿依次为CheckpointBook、股票代码(补齐到8字节)、CheckpointOrder数组
+// 每个订单簿记录生成映像时的日志seq, 回放日志时只应用该订单簿seq之后的记录
+const uint64_t CHECKPOINT_MAGIC=0x31544b435053504full;
+const uint32_t CHECKPOINT_VERSION=2;
+
+struct CheckpointHeader{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t books;
+	// 文件总字节数
+	uint64_t size;
+	// 回放起点: 开始生成检查点时日志的下一个seq, 不大于任何订单簿的journalSeq
+	uint64_t minSeq;
+	// 所有订单簿中最大的journalSeq, 日志至少要包含到这里
+	uint64_t maxSeq;
+	// 校验和: 先覆盖头部之后的全部内容, 再覆盖头部其余字段(可以边写边算)
+	uint64_t checksum;
+};
+
+struct CheckpointBook{
+	SymbolID symbol;
+	uint32_t stockLen;
+	double tickSize;
+	// 订单簿内最后分配的订单序号
+	uint64_t orderSeq;
+	// 映像包含seq小于journalSeq的全部日志记录
+	uint64_t journalSeq;
+	uint64_t orders;
+};
+
+// 挂单: 卖盘在前、买盘在后, 各自按价格优先、时间优先的顺序排列
+struct CheckpointOrder{
+	uint64_t orderID;
+	uint64_t clientID;
+	int64_t price;
+	uint64_t clOrdID;
+	uint32_t time;
+	uint32_t orderQty;
+	uint32_t leaveQty;
+	OrderSide side;
+	OrderKind kind;
+	uint16_t reserved;
+};
+static_assert(sizeof(CheckpointOrder)==48, "CheckpointOrder should be 48 bytes");
+
+// 单个订单簿的映像(在订单簿所属的线程中生成, 之后在任意线程写出)
+struct BookImage{
+	CheckpointBook book;
+	std::string stockID;
+	std::vector<CheckpointOrder> orders;
+};
+
+// 创建订单记录并挂到档位队尾(不登记), 用于从检查点或日志恢复挂单
+OrderHandle restoreOrder(OrderBook&, const CheckpointOrder&);
+// 生成订单簿的映像, journalSeq为此时日志的下一个seq
+void captureBook(OrderBook&, const uint64_t& journalSeq, BookImage&);
+// 把映像中的挂单批量挂入空订单簿: 不撮合, 订单不属于任何会话
+void restoreBook(OrderBook&, const CheckpointBook&, const CheckpointOrder*);
+
+// 顺序写出检查点文件: 逐个订单簿追加, 结束时回填头部并同步, 不需要同时持有所有订单簿的映像
+class CheckpointWriter{
+public:
+	CheckpointWriter():file_(nullptr), ok_(false), hash_(0){}
+	~CheckpointWriter();
+	CheckpointWriter(const CheckpointWriter&)=delete;
+	CheckpointWriter& operator=(const CheckpointWriter&)=delete;
+	// 创建文件, fromSeq为开始生成映像前日志的下一个seq
+	bool open(const std::string&, const uint64_t& fromSeq);
+	void add(const BookImage&);
+	// 回填头部并同步到磁盘, 任何一步失败都返回false
+	bool finish();
+private:
+	FILE* file_;
+	bool ok_;
+	CheckpointHeader header_;
+	uint64_t hash_;
+};
+
+// 写检查点: 先写临时文件并同步, 再改名替换旧文件, 不会留下不完整的检查点
+bool writeCheckpoint(const std::string&, const std::vector<BookImage>&, const uint64_t& fromSeq);
+
+// 只读映射检查点文件, 按顺序遍历订单簿
+class CheckpointFile{
+public:
+	CheckpointFile():data_(nullptr), size_(0), offset_(0){}
+	~CheckpointFile();
+	CheckpointFile(const CheckpointFile&)=delete;
+	CheckpointFile& operator=(const CheckpointFile&)=delete;
+	// 映射并校验文件, 文件不存在或损坏时返回false(error说明原因, 文件不存在时为空)
+	bool open(const std::string&, std::string& error);
+	const CheckpointHeader& header() const {return *(const CheckpointHeader*)data_;}
+	// 取出下一个订单簿, 已遍历完时返回false
+	bool next(const CheckpointBook*&, std::string& stockID, const CheckpointOrder*&);
+private:
+	const char* data_;
+	size_t size_;
+	size_t offset_;
+};
+
+#endif
@@ -0,0 +1,329 @@
+#ifndef JOURNAL_CC
+#define JOURNAL_CC
+#include "journal.h"
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+// 写线程空闲时的轮询间隔(微秒)
+static const uint32_t JOURNAL_IDLE_MICROS=100;
+// 每条记录参与校验的字节数(不含校验和本身)
+static const size_t CHECKSUM_BYTES=offsetof(JournalRecord, checksum);
+
+static uint32_t fnv1a(uint32_t hash, const char* data, size_t size){
+	for(size_t i=0;i<size;i++){
+		hash^=(uint8_t)data[i];
+		hash*=16777619u;
+	}
+	return hash;
+}
+
+// 计算记录的校验和
+uint32_t journalChecksum(const JournalRecord& record, const char* payload, size_t size){
+	uint32_t hash=fnv1a(2166136261u, (const char*)&record, CHECKSUM_BYTES);
+	return fnv1a(hash, payload, size);
+}
+
+Journal::Journal():fd_(-1), commitMicros_(DEFAULT_GROUP_COMMIT_MICROS),
+	ring_(new JournalRecord[JOURNAL_RING_CAPACITY]), ready_(new std::atomic<uint64_t>[JOURNAL_RING_CAPACITY]),
+	next_(1), released_(1), synced_(1), running_(false){
+	for(size_t i=0;i<JOURNAL_RING_CAPACITY;i++) ready_[i].store(UINT64_MAX, std::memory_order_relaxed);
+}
+
+Journal::~Journal(){
+	close();
+}
+
+// 打开日志文件并启动写线程
+bool Journal::open(const std::string& path, const uint32_t& commitMicros, const uint64_t& offset, const uint64_t& nextSeq){
+	// 截掉最后一条完整记录之后崩溃时写了一半的内容
+	fd_=::open(path.c_str(), O_WRONLY|O_CREAT|O_APPEND, 0644);
+	if(fd_<0||ftruncate(fd_, offset)!=0){
+		std::cerr<<"journal: cannot open "<<path<<": "<<strerror(errno)<<std::endl;
+		if(fd_>=0) ::close(fd_);
+		fd_=-1;
+		return false;
+	}
+	commitMicros_=commitMicros;
+	next_.store(nextSeq);
+	released_.store(nextSeq);
+	synced_.store(nextSeq);
+	running_.store(true);
+	thread_=std::thread(&Journal::loop, this);
+	return true;
+}
+
+// 停止写线程
+void Journal::close(){
+	if(!running_.exchange(false)) return;
+	thread_.join();
+	::close(fd_);
+	fd_=-1;
+}
+
+// 等待seq之前的记录全部落盘
+void Journal::waitDurable(const uint64_t& seq){
+	while(synced_.load(std::memory_order_acquire)<seq&&running_.load()){
+		std::this_thread::sleep_for(std::chrono::microseconds(JOURNAL_IDLE_MICROS));
+	}
+}
+
+// 把记录复制进seq对应的槽位
+// 逐条等待槽位释放: 连续的seq可以多于环形缓冲区的容量, 写线程写出前面的记录后再复制后面的
+void Journal::put(const uint64_t& seq, const JournalRecord& record){
+	const size_t mask=JOURNAL_RING_CAPACITY-1;
+	// 环形缓冲区已满: 等待写线程释放槽位
+	while(seq+1-released_.load(std::memory_order_acquire)>JOURNAL_RING_CAPACITY){
+		std::this_thread::yield();
+	}
+	ring_[seq&mask]=record;
+	ready_[seq&mask].store(seq, std::memory_order_release);
+}
+
+// 为记录分配seq并复制进环形缓冲区
+void Journal::append(JournalRecord& record, const char* payload, size_t size){
+	size_t blocks=(size+sizeof(JournalRecord)-1)/sizeof(JournalRecord);
+	uint64_t seq=next_.fetch_add(1+blocks, std::memory_order_relaxed);
+	record.seq=seq;
+	record.checksum=journalChecksum(record, payload, size);
+	put(seq, record);
+	JournalRecord block;
+	for(size_t i=0;i<blocks;i++){
+		size_t n=std::min(size-i*sizeof(JournalRecord), sizeof(JournalRecord));
+		memset(&block, 0, sizeof(JournalRecord));
+		memcpy(&block, payload+i*sizeof(JournalRecord), n);
+		put(seq+1+i, block);
+	}
+}
+
+// 为事件分配连续的seq: 事件记录在前, 成交记录依次在后
+void Journal::appendEvent(JournalRecord& record, const std::vector<JournalFill>& fills){
+	uint64_t seq=next_.fetch_add(1+fills.size(), std::memory_order_relaxed);
+	record.seq=seq;
+	record.fills=fills.size();
+	record.checksum=journalChecksum(record);
+	put(seq, record);
+	JournalRecord fill;
+	memset(&fill, 0, sizeof(fill));
+	fill.type=JOURNAL_FILL;
+	fill.time=time(NULL);
+	fill.orderID=record.orderID;
+	for(size_t i=0;i<fills.size();i++){
+		fill.seq=seq+1+i;
+		fill.other=fills[i].passiveID;
+		fill.price=fills[i].price;
+		fill.qty=fills[i].qty;
+		fill.checksum=journalChecksum(fill);
+		put(fill.seq, fill);
+	}
+}
+
+void Journal::start(){
+	JournalRecord record;
+	memset(&record, 0, sizeof(record));
+	record.type=JOURNAL_START;
+	record.time=time(NULL);
+	append(record);
+}
+
+void Journal::book(const SymbolID& symbol, const std::string& stockID, const double& tickSize){
+	JournalRecord record;
+	memset(&record, 0, sizeof(record));
+	record.type=JOURNAL_BOOK;
+	record.time=time(NULL);
+	record.orderID=symbol;
+	memcpy(&record.price, &tickSize, sizeof(tickSize));
+	record.qty=stockID.size();
+	append(record, stockID.data(), stockID.size());
+}
+
+void Journal::accept(const OrderRecord& order, const uint64_t& clOrdID, const int64_t& price, const std::vector<JournalFill>& fills){
+	JournalRecord record;
+	memset(&record, 0, sizeof(record));
+	record.type=JOURNAL_ACCEPT;
+	record.side=order.side;
+	record.kind=order.kind;
+	// 撮合后市价单的价位被改为市价
+	record.flags=order.price!=price ? JOURNAL_AT_MARKET: 0;
+	record.time=order.time;
+	record.orderID=order.orderID;
+	record.other=order.clientID;
+	record.price=price;
+	record.clOrdID=clOrdID;
+	record.qty=order.orderQty;
+	record.leaveQty=order.leaveQty;
+	appendEvent(record, fills);
+}
+
+void Journal::cancel(const OrderRecord& order){
+	JournalRecord record;
+	memset(&record, 0, sizeof(record));
+	record.type=JOURNAL_CANCEL;
+	record.side=order.side;
+	record.kind=order.kind;
+	record.time=time(NULL);
+	record.orderID=order.orderID;
+	record.other=order.clientID;
+	record.price=order.price;
+	record.qty=order.orderQty;
+	record.leaveQty=order.leaveQty;
+	append(record);
+}
+
+void Journal::replace(const OrderRecord& order, const bool& requeue, const std::vector<JournalFill>& fills){
+	JournalRecord record;
+	memset(&record, 0, sizeof(record));
+	record.type=JOURNAL_REPLACE;
+	record.side=order.side;
+	record.kind=order.kind;
+	record.flags=requeue ? JOURNAL_REQUEUE: 0;
+	record.time=order.time;
+	record.orderID=order.orderID;
+	record.other=order.clientID;
+	record.price=order.price;
+	record.qty=order.orderQty;
+	record.leaveQty=order.leaveQty;
+	appendEvent(record, fills);
+}
+
+// 把已就绪的连续记录写入文件
+size_t Journal::drain(){
+	const size_t mask=JOURNAL_RING_CAPACITY-1;
+	uint64_t begin=released_.load(std::memory_order_relaxed);
+	uint64_t end=begin;
+	while(end-begin<JOURNAL_RING_CAPACITY&&ready_[end&mask].load(std::memory_order_acquire)==end) end++;
+	if(end==begin) return 0;
+	// 跨过环形缓冲区末尾时分两段写
+	size_t first=begin&mask, count=end-begin;
+	size_t head=std::min(count, JOURNAL_RING_CAPACITY-first);
+	struct iovec iov[2];
+	iov[0].iov_base=&ring_[first];
+	iov[0].iov_len=head*sizeof(JournalRecord);
+	iov[1].iov_base=&ring_[0];
+	iov[1].iov_len=(count-head)*sizeof(JournalRecord);
+	int iovcnt=count>head ? 2: 1;
+	struct iovec* cur=iov;
+	while(iovcnt>0){
+		ssize_t n=writev(fd_, cur, iovcnt);
+		if(n<0&&errno==EINTR) continue;
+		if(n<0){
+			// 无法保证持久性, 不能继续接受订单
+			std::cerr<<"journal: write failed: "<<strerror(errno)<<std::endl;
+			abort();
+		}
+		while(iovcnt>0&&(size_t)n>=cur->iov_len){
+			n-=cur->iov_len;
+			cur++;
+			iovcnt--;
+		}
+		if(iovcnt>0){
+			cur->iov_base=(char*)cur->iov_base+n;
+			cur->iov_len-=n;
+		}
+	}
+	released_.store(end, std::memory_order_release);
+	return count;
+}
+
+// 写线程主循环: 有记录就写, 距上次同步超过组提交间隔时fdatasync
+void Journal::loop(){
+	auto lastSync=std::chrono::steady_clock::now();
+	bool dirty=false;
+	for(;;){
+		bool stopping=!running_.load();
+		size_t n=drain();
+		if(n>0) dirty=true;
+		auto now=std::chrono::steady_clock::now();
+		if(dirty&&(stopping||now-lastSync>=std::chrono::microseconds(commitMicros_))){
+			uint64_t written=released_.load(std::memory_order_relaxed);
+			if(fdatasync(fd_)!=0){
+				std::cerr<<"journal: fdatasync failed: "<<strerror(errno)<<std::endl;
+				abort();
+			}
+			synced_.store(written, std::memory_order_release);
+			dirty=false;
+			lastSync=now;
+		}
+		if(n>0) continue;
+		if(stopping&&released_.load()==next_.load()) break;
+		std::this_thread::sleep_for(std::chrono::microseconds(std::min(commitMicros_, JOURNAL_IDLE_MICROS)));
+	}
+}
+
+bool JournalReader::open(const std::string& path){
+	file_=fopen(path.c_str(), "rb");
+	offset_=0;
+	firstSeq_=nextSeq_=1;
+	fills_.clear();
+	nextFill_=0;
+	tornOrderID_=0;
+	if(file_==nullptr) return false;
+	// 日志被截断过时第一条记录的seq不为1
+	JournalRecord record;
+	if(fread(&record, sizeof(record), 1, file_)==1) firstSeq_=nextSeq_=record.seq;
+	rewind(file_);
+	return true;
+}
+
+// 跳到seq所在的记录: 每个seq占用64字节, 文件偏移可以直接算出
+bool JournalReader::seek(const uint64_t& seq){
+	if(seq<firstSeq_) return false;
+	offset_=(seq-firstSeq_)*sizeof(JournalRecord);
+	nextSeq_=seq;
+	fills_.clear();
+	nextFill_=0;
+	return fseeko(file_, offset_, SEEK_SET)==0;
+}
+
+// 读出seq处的一条记录
+bool JournalReader::read(const uint64_t& seq, JournalRecord& record, std::string& stockID){
+	if(fread(&record, sizeof(record), 1, file_)!=1||record.seq!=seq) return false;
+	size_t blocks=journalBlocks(record);
+	stockID.clear();
+	if(blocks>0){
+		std::unique_ptr<JournalRecord[]> data(new JournalRecord[blocks]);
+		if(fread(data.get(), sizeof(JournalRecord), blocks, file_)!=blocks) return false;
+		stockID.assign((const char*)data.get(), record.qty);
+	}
+	return journalChecksum(record, stockID.data(), stockID.size())==record.checksum;
+}
+
+// 读出下一条记录: 事件先整个读入并校验, 再依次返回其中的记录
+bool JournalReader::next(JournalRecord& record, std::string& stockID){
+	if(nextFill_<fills_.size()){
+		record=fills_[nextFill_++];
+		stockID.clear();
+		return true;
+	}
+	if(!read(nextSeq_, record, stockID)) return false;
+	size_t count=1+journalBlocks(record);
+	fills_.clear();
+	nextFill_=0;
+	if(record.type==JOURNAL_ACCEPT||record.type==JOURNAL_REPLACE){
+		fills_.resize(record.fills);
+		std::string payload;
+		for(uint32_t i=0;i<record.fills;i++){
+			auto& fill=fills_[i];
+			if(!read(nextSeq_+1+i, fill, payload)||fill.type!=JOURNAL_FILL||fill.orderID!=record.orderID){
+				fills_.clear();
+				tornOrderID_=record.orderID;
+				return false;
+			}
+		}
+		count+=record.fills;
+	}else if(record.type==JOURNAL_FILL){
+		// 成交记录只能出现在事件之内
+		return false;
+	}
+	offset_+=count*sizeof(JournalRecord);
+	nextSeq_+=count;
+	return true;
+}
+#endif
@@ -0,0 +1,170 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include "order_pool.h"
+#include "symbol_table.h"
+
+// 日志记录类型
+enum JournalType : uint8_t {
+	// 新建日志的第一条记录
+	JOURNAL_START=1,
+	// 创建订单簿: orderID为股票ID, price为最小变动价位(double的位模式), qty为股票代码长度, 其后紧跟股票代码块
+	JOURNAL_BOOK=2,
+	// 接受新订单: price为报单价位, 其余字段为撮合结束后的订单状态, leaveQty>0时挂在队尾
+	JOURNAL_ACCEPT=3,
+	// 成交: orderID为主动方订单, other为被动方订单, 被动方剩余数量减qty, 减到0时离开订单簿
+	// 成交记录紧跟在产生它的ACCEPT/REPLACE记录之后, 主动方的剩余数量由该ACCEPT/REPLACE记录给出
+	JOURNAL_FILL=4,
+	// 撤单(包括批量撤单和会话断开时的撤单)
+	JOURNAL_CANCEL=5,
+	// 改单: 记录撮合结束后的订单状态, flags带JOURNAL_REQUEUE时先移到新档位的队尾
+	JOURNAL_REPLACE=6
+};
+
+// 改单失去时间优先
+const uint8_t JOURNAL_REQUEUE=1;
+// 市价单的剩余部分挂在订单簿的市价上, 而不是报单价位
+const uint8_t JOURNAL_AT_MARKET=2;
+
+// 日志记录：定长64字节, 小端序, 按seq连续编号
+// BOOK记录之后的股票代码块按64字节切分, 每块占用一个seq, 不足的部分补0
+// 一次撮合是一个事件: ACCEPT/REPLACE记录和其后的fills条FILL记录占用连续的seq, 回放时整个事件要么全部生效要么全部丢弃
+struct JournalRecord{
+	uint64_t seq;
+	JournalType type;
+	OrderSide side;
+	OrderKind kind;
+	uint8_t flags;
+	// 报单时间(秒)
+	uint32_t time;
+	uint64_t orderID;
+	// ACCEPT: 客户ID; FILL: 被动方订单ID
+	uint64_t other;
+	// ACCEPT/REPLACE: 报单价位; FILL: 成交价位
+	int64_t price;
+	uint64_t clOrdID;
+	// ACCEPT/REPLACE: 订单总量; FILL: 成交数量
+	uint32_t qty;
+	uint32_t leaveQty;
+	// ACCEPT/REPLACE: 其后紧跟的FILL记录数
+	uint32_t fills;
+	// FNV-1a校验和, 覆盖本记录前60字节, BOOK记录还覆盖股票代码
+	uint32_t checksum;
+};
+static_assert(sizeof(JournalRecord)==64, "JournalRecord should be 64 bytes");
+
+// 撮合中的一笔成交, 撮合结束后随ACCEPT/REPLACE记录一起写入日志
+struct JournalFill{
+	// 被动方订单ID
+	uint64_t passiveID;
+	// 成交价位
+	int64_t price;
+	uint32_t qty;
+};
+
+// 日志环形缓冲区的记录数(2的幂)
+const size_t JOURNAL_RING_CAPACITY=1u<<16;
+// 默认的组提交间隔(微秒)
+const uint32_t DEFAULT_GROUP_COMMIT_MICROS=1000;
+
+// 计算记录的校验和
+uint32_t journalChecksum(const JournalRecord&, const char* payload=nullptr, size_t size=0);
+// BOOK记录之后的股票代码块数
+inline size_t journalBlocks(const JournalRecord& record){
+	return record.type==JOURNAL_BOOK ? (record.qty+sizeof(JournalRecord)-1)/sizeof(JournalRecord): 0;
+}
+
+// 预写日志：撮合路径只把定长记录复制进多生产者环形缓冲区, 由专门的写线程批量写入文件
+// 写线程每隔commitMicros微秒执行一次fdatasync(组提交), 0表示每批写入后立即同步
+// 追加记录不等待落盘; 需要在落盘后才发出应答的调用者在处理之后读取nextSeq, 再等待synced覆盖它
+class Journal{
+public:
+	Journal();
+	~Journal();
+	Journal(const Journal&)=delete;
+	Journal& operator=(const Journal&)=delete;
+	// 打开日志文件并启动写线程: offset之后不完整的记录被截掉, 新记录从nextSeq开始编号
+	// offset和nextSeq取自回放日志的JournalReader
+	bool open(const std::string& path, const uint32_t& commitMicros, const uint64_t& offset, const uint64_t& nextSeq);
+	// 停止写线程, 环形缓冲区中剩余的记录先写入并同步
+	void close();
+	// 追加记录(以下接口可在任意线程并发调用)
+	void start();
+	void book(const SymbolID&, const std::string&, const double&);
+	// 新订单及其撮合产生的成交: clOrdID, 报单价位, 成交
+	void accept(const OrderRecord&, const uint64_t&, const int64_t&, const std::vector<JournalFill>&);
+	void cancel(const OrderRecord&);
+	// 改单及重新撮合产生的成交: 是否失去时间优先, 成交
+	void replace(const OrderRecord&, const bool&, const std::vector<JournalFill>&);
+	// 下一个分配的seq: 在订单簿所属的线程中读取时, 该订单簿之前的记录seq都小于它
+	uint64_t nextSeq() const {return next_.load(std::memory_order_acquire);}
+	// 等待seq之前的记录全部落盘
+	void waitDurable(const uint64_t&);
+private:
+	// 为记录(及其后的数据块)分配连续的seq, 复制进环形缓冲区
+	void append(JournalRecord&, const char* payload=nullptr, size_t size=0);
+	// 为事件记录及其后的成交记录分配连续的seq, 复制进环形缓冲区
+	void appendEvent(JournalRecord&, const std::vector<JournalFill>&);
+	// 把seq对应的记录复制进环形缓冲区的槽位, 槽位尚未被写线程释放时等待
+	void put(const uint64_t&, const JournalRecord&);
+	// 写线程主循环
+	void loop();
+	// 把已就绪的连续记录写入文件, 返回写入的记录数
+	size_t drain();
+	int fd_;
+	uint32_t commitMicros_;
+	std::unique_ptr<JournalRecord[]> ring_;
+	// 每个槽位已写入记录的seq, 等于槽位当前应写的seq时记录就绪
+	std::unique_ptr<std::atomic<uint64_t>[]> ready_;
+	// 下一个分配的seq
+	std::atomic<uint64_t> next_;
+	// 已写入文件的seq上界, 之前的槽位可以复用
+	std::atomic<uint64_t> released_;
+	// 已同步到磁盘的seq上界
+	std::atomic<uint64_t> synced_;
+	std::atomic<bool> running_;
+	std::thread thread_;
+};
+
+// 日志读取：顺序读出完整且连续的记录, 遇到文件末尾、校验失败或seq不连续时停止
+// 事件只在其全部FILL记录都完整时才读出, 最后一个不完整的事件连同之后的内容视为未写完
+class JournalReader{
+public:
+	JournalReader():file_(nullptr), offset_(0), firstSeq_(1), nextSeq_(1), nextFill_(0), tornOrderID_(0){}
+	~JournalReader(){if(file_!=nullptr) fclose(file_);}
+	JournalReader(const JournalReader&)=delete;
+	JournalReader& operator=(const JournalReader&)=delete;
+	// 打开日志文件, 文件不存在时返回false
+	bool open(const std::string& path);
+	// 跳到seq所在的记录(seq必须是记录或事件的起始seq), 早于文件第一条记录时返回false
+	bool seek(const uint64_t& seq);
+	// 读出下一条记录, BOOK记录的股票代码写入stockID; 事件的FILL记录紧跟在ACCEPT/REPLACE记录之后读出
+	bool next(JournalRecord&, std::string& stockID);
+	// 最后一个完整事件之后的文件偏移
+	uint64_t offset() const {return offset_;}
+	// 下一个事件应有的seq
+	uint64_t nextSeq() const {return nextSeq_;}
+	// 读到的最后一个不完整事件的订单ID, 没有时为0
+	uint64_t tornOrderID() const {return tornOrderID_;}
+private:
+	// 读出seq处的一条记录, 不移动offset_和nextSeq_
+	bool read(const uint64_t& seq, JournalRecord&, std::string& stockID);
+	FILE* file_;
+	uint64_t offset_;
+	// 文件第一条记录的seq
+	uint64_t firstSeq_;
+	uint64_t nextSeq_;
+	// 已读出事件中尚未返回的FILL记录
+	std::vector<JournalRecord> fills_;
+	size_t nextFill_;
+	uint64_t tornOrderID_;
+};
+
+#endif
@@ -1,455 +1,894 @@
 #ifndef MARKET_CC
 #define MARKET_CC
 #include "market.h"
+#include "checkpoint.h"
+#include <chrono>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 TradingMarket* TradingMarket::m_instance=new TradingMarket;
 
+// 本线程正在进行的撮合产生的成交, 撮合结束后随ACCEPT/REPLACE记录一起写入日志, 两者占用连续的seq
+static thread_local std::vector<JournalFill> journalFills;
+
+// 在订单簿所属的线程中执行操作
+template<typename F>
+void TradingMarket::runOnBook(OrderBook& book, F&& func){
+	if(shards.empty()){
+		// 加锁模式: 持订单簿锁在当前线程执行, 作用域结束自动解锁
+		std::unique_lock<std::mutex> lk(book.mutex);
+		func();
+	}else{
+		// 分片模式: 交给订单簿所属的撮合线程执行并等待完成, 有变化的订单簿登记下来, 由撮合线程批量发布快照
+		auto shard=book.symbol()%shards.size();
+		auto run=[&](){
+			bool stale=book.snapshotStale();
+			func();
+			if(!stale&&book.snapshotStale()) unpublished[shard].push_back(&book);
+		};
+		CallableTask<decltype(run)> task(run);
+		shards[shard]->execute(&task);
+	}
+}
+
+// 发布撮合线程修改过的订单簿的快照
+void TradingMarket::publishSnapshots(const size_t& shard){
+	for(auto book:unpublished[shard]) book->publishSnapshot();
+	unpublished[shard].clear();
+}
+
+// 启动加锁模式的快照线程
+void TradingMarket::startSnapshotThread(){
+	snapshotStop=false;
+	snapshotThread=std::thread([this](){
+		std::unique_lock<std::mutex> lk(snapshotMutex);
+		while(!snapshotCv.wait_for(lk, std::chrono::microseconds(SNAPSHOT_PUBLISH_MICROS), [this](){return snapshotStop;})){
+			lk.unlock();
+			// 每次只持有一把订单簿锁, 只重建上次发布之后变化的页
+			for(SymbolID symbol=0;symbol<symbols.size();symbol++){
+				auto book=findOrderBook(symbol);
+				if(book==nullptr||!book->snapshotStale()) continue;
+				std::unique_lock<std::mutex> bookLock(book->mutex);
+				book->publishSnapshot();
+			}
+			lk.lock();
+		}
+	});
+}
+
+// 停止加锁模式的快照线程
+void TradingMarket::stopSnapshotThread(){
+	{
+		std::unique_lock<std::mutex> lk(snapshotMutex);
+		snapshotStop=true;
+	}
+	snapshotCv.notify_all();
+	if(snapshotThread.joinable()) snapshotThread.join();
+}
+
+// 根据新订单请求初始化应答
+static void initReport(Execution& report, const NewOrder& request){
+	report.stat=EXEC_REJECT;
+	report.clientID=request.clientID;
+	report.orderID=0;
+	report.clOrdID=request.clOrdID;
+	report.stockID=request.stockID;
+	report.orderQty=request.orderQty;
+	report.orderPrice=request.price;
+	report.orderPriceTicks=request.priceTicks;
+	report.leaveQty=request.orderQty;
+}
+
+// 根据改单请求初始化应答
+static void initReport(Execution& report, const AmendOrder& request){
+	report.stat=EXEC_REPLACE_REJECT;
+	report.orderID=request.orderID;
+	report.orderQty=request.orderQty;
+	report.orderPrice=request.price;
+	report.orderPriceTicks=request.priceTicks;
+}
+
+// 根据订单记录初始化成交应答
+static void initReport(Execution& report, const OrderHandle& handle, const OrderBook& book){
+	auto& order=book.pool().get(handle);
+	report.stat=EXEC_FILL;
+	report.clientID=order.clientID;
+	report.orderID=order.orderID;
+	report.clOrdID=book.pool().clOrdID(handle);
+	report.stockID=book.stockID();
+	report.orderQty=order.orderQty;
+	report.orderPrice=book.toPrice(order.price);
+	report.orderPriceTicks=order.price;
+	report.leaveQty=order.leaveQty;
+	report.time=time(NULL);
+}
+
+// 设置成交价格
+static void setFillPrice(Execution& report, const int64_t& fillPrice, const OrderBook& book){
+	report.fillPrice=book.toPrice(fillPrice);
+	report.fillPriceTicks=fillPrice;
+}
+
+// 设置错误信息
+static void setError(Execution& report, const char* error){
+	report.error=error;
+	report.time=time(NULL);
+}
+
+// 根据快照中的订单初始化查询应答
+static void initReport(OrderInfo& report, const OrderView& order, const OrderBook& book){
+	report.orderID=order.orderID;
+	report.clientID=order.clientID;
+	report.side=order.side;
+	report.kind=order.kind;
+	report.stockID=book.stockID();
+	report.orderQty=order.leaveQty;
+	report.price=book.toPrice(order.price);
+	report.priceTicks=order.price;
+	report.time=order.time;
+}
+
+// 判断订单的合法性, 合法时返回nullptr
+static const char* checkRequest(const NewOrder& request){
+	if(request.clientID<=0) return "Error: ClientID is illegal!";
+	if(request.stockID.size()<=0) return "Error: StockID is illegal!";
+	if(request.side!=SIDE_SELL&&request.side!=SIDE_BUY) return "Error: Order direction is illegal!";
+	if(request.orderQty<=0) return "Error: Order quantity is illegal!";
+	if(request.price<=0&&request.priceTicks<=0) return "Error: Order price is illegal!";
+	if(request.price<0||request.priceTicks<0) return "Error: Order price is illegal!";
+	if(request.kind!=KIND_LIMIT&&request.kind!=KIND_MARKET) return "Error: Order type is illegal!";
+	return nullptr;
+}
+
 // 根据新订单请求做出应答消息
-void TradingMarket::processNewOrder(const NewOrderRequest& request, std::vector<std::pair<uint64_t, ExecutionReport> >& reports, uint64_t& orderID_){
-	// 错误信息
-	std::string errorMessage="";
+void TradingMarket::processNewOrder(const NewOrder& request, const SessionID& session, std::vector<std::pair<SessionID, Execution> >& reports, uint64_t& orderID_){
 	// 初始化应答
-	ExecutionReport report;
+	Execution report;
 	initReport(report, request);
 	// 判断订单的合法性
-	if(!checkRequest(request, errorMessage)){
+	if(auto error=checkRequest(request)){
 		// 非法订单输出报错信息
-		report.set_time(getTime());
-		report.set_errormessage(errorMessage);
-		reports.push_back(std::make_pair(0, report));
+		setError(report, error);
+		reports.push_back(std::make_pair(NO_SESSION, report));
+		return;
+	}
+	// 将股票代码转换为股票ID, 之后的处理只使用整数ID
+	auto symbol=symbols.intern(request.stockID);
+	if(symbol==INVALID_SYMBOL){
+		setError(report, "Error: Too many stocks!");
+		reports.push_back(std::make_pair(NO_SESSION, report));
+		return;
+	}
+	// 获取订单对应的订单簿
+	auto& book=getOrderBook(symbol, request.stockID);
+	// 将报单价格换算为整数价位
+	int64_t price=request.priceTicks;
+	if(price==0&&!book.toTicks(request.price, price)){
+		setError(report, "Error: Order price is not a multiple of tick size!");
+		reports.push_back(std::make_pair(NO_SESSION, report));
 		return;
 	}
+	// 在订单簿所属的线程中撮合与挂单, 两者之间订单簿不会被其他请求修改
+	runOnBook(book, [&](){
+		size_t first=reports.size();
+		matchNewOrder(book, request, price, session, reports, orderID_);
+		emitReports(reports.data()+first, reports.size()-first);
+	});
+}
+
+// 将一次操作在订单簿中产生的应答交给应答回调, 同时给出其日志记录落盘所需等待的seq
+void TradingMarket::emitReports(const std::pair<SessionID, Execution>* reports, const size_t& count){
+	if(reportSink&&count>0) reportSink(reports, count, journalSeq());
+}
+
+// 新订单撮合与挂单
+void TradingMarket::matchNewOrder(OrderBook& book, const NewOrder& request, const int64_t& price, const SessionID& session,
+		std::vector<std::pair<SessionID, Execution> >& reports, uint64_t& orderID_){
+	// 初始化应答
+	Execution report;
+	initReport(report, request);
 	// 创建订单
-	auto orderID=createOrder(request);
+	auto handle=createOrder(book, request, price, session);
+	auto& order=book.pool().get(handle);
 	// 将订单ID返回给服务器
-	orderID_=orderID;
+	orderID_=order.orderID;
 	// 输出订单创建成功的消息
-	report.set_stat(ExecutionReport::ORDER_ACCEPT);
-	report.set_orderid(orderID);
-	report.set_time(getTime());
-	reports.push_back(std::make_pair(orderID, report));
-	// 获取订单对应的股票ID
-	auto stockID=request.stockid();
-	// Sell
-	if(request.direction()==NewOrderRequest::SELL){
-		// 对stockID的买订单集合加锁,作用域结束自动解锁
-		std::unique_lock<std::mutex> lg(*stock_mutex[stockID].second);
-		// 存在该股票且订单数不为0, 搜索买订单
-		if(existInContainers(stockID)&&getBuyOrderSet(stockID).size()>0){
-			sellOrders(orderID, stockID, reports);
+	report.stat=EXEC_ACCEPT;
+	report.orderID=order.orderID;
+	report.orderPrice=book.toPrice(order.price);
+	report.orderPriceTicks=order.price;
+	report.time=time(NULL);
+	reports.push_back(std::make_pair(order.session, report));
+	journalFills.clear();
+	// Sell: 存在买单时与买盘撮合
+	if(order.side==SIDE_SELL){
+		if(book.hasBid()){
+			sellOrders(handle, book, reports);
 		}
-	// Buy
+	// Buy: 存在卖单时与卖盘撮合
 	}else{
-		// 对stockID的卖订单集合加锁,作用域结束自动解锁
-		std::unique_lock<std::mutex> lg(*stock_mutex[stockID].first);
-		// 存在该股票且订单数不为0, 搜索卖订单
-		if(existInContainers(stockID)&&getSellOrderSet(stockID).size()>0){
-			buyOrders(orderID, stockID, reports);	
+		if(book.hasAsk()){
+			buyOrders(handle, book, reports);
 		}
 	}
-	// 分开的缺点：order不能及时插入容器中
-	// Sell
-	if(request.direction()==NewOrderRequest::SELL){
-		// 对stockID的卖订单集合加锁,作用域结束自动解锁
-		std::unique_lock<std::mutex> lg(*stock_mutex[stockID].first);
-		// 剩余待售卖订单数不为0, 加入sell集合, 否则从订单集合中删除该订单
-		if(selectOrder(orderID).orderqty()>0){
-			addOrderToSell(stockID, orderID);
-		}else{
-			deleteOrder(orderID);
-		}
-	// Buy
+	// 日志先记录报单价位和撮合结束后的订单状态, 再记录本次撮合的成交
+	if(journal) journal->accept(order, book.pool().clOrdID(handle), price, journalFills);
+	// 剩余待成交数量不为0, 挂入订单簿, 否则释放该订单
+	if(restOrder(book, handle)){
+		book.indexOrder(handle);
+	}
+}
+
+// 订单撮合后剩余数量挂入订单簿, 全部成交则释放订单
+bool TradingMarket::restOrder(OrderBook& book, const OrderHandle& handle){
+	auto& order=book.pool().get(handle);
+	if(order.leaveQty==0){
+		book.pool().release(handle);
+		return false;
+	}
+	if(order.side==SIDE_SELL){
+		book.addAsk(order.price, handle);
 	}else{
-		// 对stockID的买订单集合加锁,作用域结束自动解锁
-		std::unique_lock<std::mutex> lg(*stock_mutex[stockID].second);
-		// 剩余待购买订单数不为0, 加入buy集合, 否则从订单集合中删除该订单
-		if(selectOrder(orderID).orderqty()>0){
-			addOrderToBuy(stockID, orderID);
-		}else{
-			deleteOrder(orderID);
+		book.addBid(order.price, handle);
+	}
+	return true;
+}
+
+// 撤销订单ID对应的订单
+void TradingMarket::processCancelOrder(const uint64_t& orderID, Execution& report, SessionID& session){
+	// 初始化应答
+	report=Execution();
+	session=NO_SESSION;
+	report.stat=EXEC_CANCEL_REJECT;
+	report.orderID=orderID;
+	// 由订单ID得到所属订单簿
+	auto book=findOrderBook(orderSymbol(orderID));
+	if(book==nullptr){
+		setError(report, "Error: Can not find OrderID!");
+		return;
+	}
+	// 在订单簿所属的线程中撤单
+	runOnBook(*book, [&](){
+		cancelOrder(*book, orderID, report, session);
+		if(session!=NO_SESSION){
+			auto canceled=std::make_pair(session, report);
+			emitReports(&canceled, 1);
 		}
+	});
+}
+
+// 从订单簿中撤销订单
+void TradingMarket::cancelOrder(OrderBook& book, const uint64_t& orderID, Execution& report, SessionID& session){
+	// 查找并删除挂单登记, 失败说明订单不存在或已全部成交
+	OrderHandle handle;
+	if(!book.findOrder(orderID, handle)){
+		setError(report, "Error: Can not find OrderID!");
+		return;
 	}
+	book.unindexOrder(handle);
+	auto& order=book.pool().get(handle);
+	if(journal) journal->cancel(order);
+	// 通过订单记录中的链表指针直接从价格档位中摘除, O(1)
+	book.removeOrder(handle);
+
+	report.stat=EXEC_CANCELED;
+	report.clientID=order.clientID;
+	report.clOrdID=book.pool().clOrdID(handle);
+	report.stockID=book.stockID();
+	report.orderQty=order.orderQty;
+	report.orderPrice=book.toPrice(order.price);
+	report.orderPriceTicks=order.price;
+	report.leaveQty=order.leaveQty;
+	report.time=time(NULL);
+	session=order.session;
+	// 释放订单记录
+	book.pool().release(handle);
 }
 
-// 根据撤销订单请求做出应答消息
-void TradingMarket::processCancelOrder(const CancelOrderRequest& request, ExecutionReport& report){
+// 根据改单请求做出应答消息
+void TradingMarket::processAmendOrder(const AmendOrder& request, std::vector<std::pair<SessionID, Execution> >& reports){
 	// 错误信息
-	std::string errorMessage="";
-	uint64_t orderID=request.orderid();;
-	NewOrderRequest order;
-	std::string stockID;
-	// 获取order
-	if(!isExistAndGetOrder(orderID, order)){
-		errorMessage="Error: Can not find OrderID!";
-		report.set_time(getTime());
-		report.set_errormessage(errorMessage);
-		return;	
-	}
-	stockID=order.stockid();
-	
-	if(order.direction()==NewOrderRequest::SELL){
-		// 对stockID的卖订单集合加锁,作用域结束自动解锁
-		std::unique_lock<std::mutex> lk(*stock_mutex[stockID].first);
-		// 从订单容器中删除订单
-		if(!deleteOrder(orderID)){
-			errorMessage="Error: Can not find OrderID!";
-			report.set_time(getTime());
-			report.set_errormessage(errorMessage);
-			return;	
+	const char* error=nullptr;
+	// 初始化应答
+	Execution report;
+	initReport(report, request);
+	uint64_t orderID=request.orderID;
+	// 由订单ID得到所属订单簿
+	auto book=findOrderBook(orderSymbol(orderID));
+	// 将新价格换算为整数价位, 0表示不改价
+	int64_t price=request.priceTicks;
+	if(book==nullptr){
+		error="Error: Can not find OrderID!";
+	}else if(request.price<0||price<0){
+		error="Error: Order price is illegal!";
+	}else if(price==0&&request.price>0&&!book->toTicks(request.price, price)){
+		error="Error: Order price is not a multiple of tick size!";
+	}else if(price==0&&request.orderQty==0){
+		error="Error: Nothing to amend!";
+	}
+	if(error!=nullptr){
+		setError(report, error);
+		reports.push_back(std::make_pair(NO_SESSION, report));
+		return;
+	}
+	// 在订单簿所属的线程中改单, 改价后的撮合与挂单同在一次操作内完成, 订单不会出现不在订单簿中的窗口
+	runOnBook(*book, [&](){
+		size_t first=reports.size();
+		amendOrder(*book, orderID, request.orderQty, price, report, reports);
+		emitReports(reports.data()+first, reports.size()-first);
+	});
+}
+
+// 修改订单的数量和价格
+void TradingMarket::amendOrder(OrderBook& book, const uint64_t& orderID, const uint32_t& qty, const int64_t& price,
+		Execution& report, std::vector<std::pair<SessionID, Execution> >& reports){
+	OrderHandle handle;
+	if(!book.findOrder(orderID, handle)){
+		setError(report, "Error: Can not find OrderID!");
+		reports.push_back(std::make_pair(NO_SESSION, report));
+		return;
+	}
+	auto& order=book.pool().get(handle);
+	// 已成交数量
+	uint32_t filled=order.orderQty-order.leaveQty;
+	uint32_t newQty=qty>0 ? qty: order.orderQty;
+	int64_t newPrice=price>0 ? price: order.price;
+	if(newQty<=filled){
+		setError(report, "Error: Amended quantity must exceed filled quantity!");
+		reports.push_back(std::make_pair(NO_SESSION, report));
+		return;
+	}
+	// 改价或增加数量时失去时间优先
+	bool requeue=newPrice!=order.price||newQty>order.orderQty;
+	if(requeue){
+		book.removeOrder(handle);
+		order.time=time(NULL);
+	}
+	order.orderQty=newQty;
+	order.leaveQty=newQty-filled;
+	book.touchOrder(handle);
+	if(price>0){
+		// 指定了价格的订单按限价单处理
+		order.price=newPrice;
+		order.kind=KIND_LIMIT;
+	}
+	// 输出改单成功的消息
+	initReport(report, handle, book);
+	report.stat=EXEC_REPLACED;
+	reports.push_back(std::make_pair(order.session, report));
+	// 只减少数量: 原地修改, 保持在档位中的位置
+	journalFills.clear();
+	if(!requeue){
+		if(journal) journal->replace(order, false, journalFills);
+		return;
+	}
+	// 按新的价格和数量重新撮合, 剩余部分挂到新档位的队尾
+	if(order.side==SIDE_SELL){
+		if(book.hasBid()){
+			sellOrders(handle, book, reports);
+		}
+	}else{
+		if(book.hasAsk()){
+			buyOrders(handle, book, reports);
+		}
+	}
+	if(journal) journal->replace(order, true, journalFills);
+	// 全部成交时先删除挂单登记再释放
+	if(order.leaveQty==0){
+		book.unindexOrder(handle);
+	}
+	restOrder(book, handle);
+}
+
+// 根据批量撤单请求撤销客户的挂单
+void TradingMarket::processMassCancel(const MassCancel& request, MassCancelResult& report){
+	report=MassCancelResult();
+	report.clientID=request.clientID;
+	if(request.clientID<=0){
+		report.error="Error: ClientID is illegal!";
+		report.time=time(NULL);
+		return;
+	}
+	auto clientID=request.clientID;
+	auto side=request.side;
+	if(request.stockID.size()>0){
+		// 只撤指定股票: 股票不存在时没有可撤的订单
+		auto book=findOrderBook(symbols.find(request.stockID));
+		if(book!=nullptr){
+			runOnBook(*book, [&](){
+				cancelClientOrders(*book, clientID, side, report);
+			});
 		}
-		// 从卖集合容器中删除订单
-		delOrderFromSell(stockID, orderID);
 	}else{
-		// 对stockID的买订单集合加锁,作用域结束自动解锁
-		std::unique_lock<std::mutex> lk(*stock_mutex[stockID].second);
-		// 从订单容器中删除订单
-		if(!deleteOrder(orderID)){
-			errorMessage="Error: Can not find OrderID!";
-			report.set_time(getTime());
-			report.set_errormessage(errorMessage);
-			return;	
+		// 逐个订单簿撤单, 每个订单簿一次操作
+		for(uint32_t symbol=0;symbol<symbols.size();symbol++){
+			auto book=books[symbol].load(std::memory_order_acquire);
+			if(book==nullptr) continue;
+			runOnBook(*book, [&](){
+				cancelClientOrders(*book, clientID, side, report);
+			});
 		}
-		// 从买集合容器中删除订单
-		delOrderFromBuy(stockID, orderID);
 	}
-	
-	report.set_stat(ExecutionReport::CANCELED);
-	report.set_clientid(order.clientid());
-	report.set_stockid(stockID);
-	report.set_orderqty(order.orderqty());
-	report.set_orderprice(order.price());
-	report.set_leaveqty(order.orderqty());
-	report.set_time(getTime());
+	report.time=time(NULL);
+}
+
+// 撤销会话中给定客户的全部挂单
+void TradingMarket::cancelSessionOrders(const SessionID& session, const std::set<uint64_t>& clientIDs, MassCancelResult& report){
+	for(uint32_t symbol=0;symbol<symbols.size();symbol++){
+		auto book=books[symbol].load(std::memory_order_acquire);
+		if(book==nullptr) continue;
+		runOnBook(*book, [&](){
+			for(auto& clientID:clientIDs){
+				cancelClientOrders(*book, clientID, FILTER_BOTH, report, session);
+			}
+		});
+	}
+	report.time=time(NULL);
+}
+
+// 撤销客户在订单簿中的挂单: 沿客户挂单链表遍历, 不扫描整个订单簿
+void TradingMarket::cancelClientOrders(OrderBook& book, const uint64_t& clientID, const SideFilter& side, MassCancelResult& report, const SessionID& session){
+	for(auto handle=book.firstClientOrder(clientID); handle!=NIL_HANDLE;){
+		auto& order=book.pool().get(handle);
+		auto next=order.clientNext;
+		if(session!=NO_SESSION&&order.session!=session){
+			handle=next;
+			continue;
+		}
+		if(side==FILTER_BOTH
+				||(side==FILTER_SELL&&order.side==SIDE_SELL)
+				||(side==FILTER_BUY&&order.side==SIDE_BUY)){
+			report.canceledOrders++;
+			report.canceledQty+=order.leaveQty;
+			report.orderIDs.push_back(order.orderID);
+			if(journal) journal->cancel(order);
+			book.unindexOrder(handle);
+			book.removeOrder(handle);
+			book.pool().release(handle);
+		}
+		handle=next;
+	}
 }
 
 // 根据查询订单请求做出应答消息
-void TradingMarket::processQueryOrder(const QueryOrderRequest& request, std::vector<OrderReport>& reports){
-	getAllOrders(reports);
-	std::sort(reports.begin(), reports.end(), [&](const OrderReport& a, const OrderReport& b){return a.orderid()<b.orderid();});
-}
-
-// 卖订单操作
-void TradingMarket::sellOrders(const uint64_t& orderID, const std::string& stockID, 
-		std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
-	// 获取卖订单
-	NewOrderRequest sellOrder=selectOrder(orderID);
-	// 记录成交的数量
-	uint32_t cnt=0; 
-	{
-		// 买订单容器
-		auto& orderSet=getBuyOrderSet(stockID);
-		// 遍历容器
-		for(auto it=orderSet.begin(); it!=orderSet.end();){
-			if(cnt>=sellOrder.orderqty()) break;
-			auto buyOrderID=*it;
-			auto buyOrder=selectOrder(buyOrderID);
+void TradingMarket::processQueryOrder(const OrderQuery& request, std::vector<OrderInfo>& reports){
+	QueryFilter filter;
+	filter.clientID=request.clientID;
+	filter.side=request.side;
+	// 游标之后的订单, 且不小于minOrderID
+	filter.lower=std::max(request.cursor+1, request.minOrderID);
+	filter.upper=request.maxOrderID>0 ? request.maxOrderID: UINT64_MAX;
+	filter.pageSize=request.pageSize>0&&request.pageSize<MAX_QUERY_PAGE ? request.pageSize: MAX_QUERY_PAGE;
+	if(request.cursor==UINT64_MAX||filter.lower>filter.upper) return;
+	// 订单ID的高位为股票ID, 按股票ID从小到大遍历订单簿即为按订单ID排序
+	SymbolID first=orderSymbol(filter.lower);
+	if(first==INVALID_SYMBOL) first=0;
+	SymbolID last=symbols.size();
+	auto upperSymbol=orderSymbol(filter.upper);
+	if(upperSymbol!=INVALID_SYMBOL&&upperSymbol<last) last=upperSymbol+1;
+	if(request.stockID.size()>0){
+		auto symbol=symbols.find(request.stockID);
+		if(symbol==INVALID_SYMBOL||symbol<first||symbol>=last) return;
+		first=symbol;
+		last=symbol+1;
+	}
+	reports.reserve(filter.pageSize);
+	for(SymbolID symbol=first;symbol<last&&reports.size()<filter.pageSize;symbol++){
+		auto book=books[symbol].load(std::memory_order_acquire);
+		if(book==nullptr) continue;
+		// 只读取订单簿最近发布的快照: 快照由撮合一方发布, 查询不占用撮合线程, 也不持有任何锁
+		auto snapshot=book->snapshot();
+		if(snapshot==nullptr) continue;
+		collectOrders(*book, *snapshot, filter, reports);
+	}
+}
+
+// 卖订单操作: 从最优买价开始逐档撮合, 遇到第一个不能成交的价位即停止
+void TradingMarket::sellOrders(const OrderHandle& handle, OrderBook& book,
+		std::vector<std::pair<SessionID, Execution> >& reports){
+	auto& pool=book.pool();
+	// 获取卖订单, 成交数量直接在订单记录上修改
+	auto& sellOrder=pool.get(handle);
+	// 买盘
+	auto& levels=book.bids();
+	for(auto lv=levels.begin(); lv!=levels.end()&&sellOrder.leaveQty>0;){
+		// 买价低于卖价, 后续价位均无法成交
+		if(sellOrder.price>lv->first) break;
+		auto fillPrice=lv->first;
+		// 同一价位按时间优先成交
+		auto& level=lv->second;
+		for(auto it=level.head; it!=NIL_HANDLE&&sellOrder.leaveQty>0;){
+			auto& buyOrder=pool.get(it);
+			// 先取出后一笔订单, 当前订单成交完后会被摘除
+			auto next=buyOrder.next;
 			// 不能与同一用户发布的订单进行交易
-			if(sellOrder.clientid()==buyOrder.clientid()){
-				it++;
-				continue;	
-			}
-			// 判断价格是否可以卖出 TODO: 优化价格判断
-			if(sellOrder.price()-MINN>buyOrder.price()){
-				it++;
+			if(sellOrder.clientID==buyOrder.clientID){
+				it=next;
 				continue;
 			}
-			double fillPrice=buyOrder.price();
 			// 计算可卖出的数量
-			auto tradNum=std::min(buyOrder.orderqty(), sellOrder.orderqty()-cnt);
-			cnt+=tradNum;
+			auto tradNum=std::min(buyOrder.leaveQty, sellOrder.leaveQty);
+			sellOrder.leaveQty-=tradNum;
+			buyOrder.leaveQty-=tradNum;
+			if(journal) journalFills.push_back(JournalFill{buyOrder.orderID, fillPrice, tradNum});
 			// 设置当前订单交易成功的应答
-			ExecutionReport report;
-			initReport(report, sellOrder);
-			report.set_stat(ExecutionReport::FILL);
-			report.set_orderid(orderID);
-			report.set_fillqty(tradNum);
-			report.set_fillprice(fillPrice);
-			report.set_leaveqty(sellOrder.orderqty()-cnt);
-			report.set_time(getTime());
+			Execution report;
+			initReport(report, handle, book);
+			report.fillQty=tradNum;
+			setFillPrice(report, fillPrice, book);
 			// 设置buy订单交易成功的应答
-			ExecutionReport report_;
-			initReport(report_, buyOrder);
-			report_.set_stat(ExecutionReport::FILL);
-			report_.set_orderid(buyOrderID);
-			report_.set_fillqty(tradNum);
-			report_.set_fillprice(fillPrice);
-			report_.set_leaveqty(buyOrder.orderqty()-tradNum);
-			report_.set_time(getTime());
-			// 从数据库中修改buy订单的库存量
-			auto num=buyOrder.orderqty();
-			buyOrder.set_orderqty(num-tradNum);
-			alterOrder(buyOrderID, buyOrder);
-			// 获取buy和sell order的stream
-			// auto& sellOrder_stream=orderID_stream[orderID];
-			// auto& buyOrder_stream=orderID_stream[buyOrderID];
+			Execution report_;
+			initReport(report_, it, book);
+			report_.fillQty=tradNum;
+			setFillPrice(report_, fillPrice, book);
 			// 发出report
-			reports.push_back(std::make_pair(orderID, report));
-			reports.push_back(std::make_pair(buyOrderID, report_));
-			//sellOrder_stream->Write(report);
-			//buyOrder_stream->Write(report_);
+			reports.push_back(std::make_pair(sellOrder.session, report));
+			reports.push_back(std::make_pair(buyOrder.session, report_));
 			// 判断订单的数量是否大于0
-			if(buyOrder.orderqty()==0){
-				orderSet.erase(it++);
-				deleteOrder(buyOrderID);
-			} 
-			else {
-				it++;
+			if(buyOrder.leaveQty==0){
+				book.unindexOrder(it);
+				book.unlink(it);
+				pool.release(it);
+			}else{
+				book.touchOrder(it);
 			}
+			it=next;
+		}
+		// 价位已无订单时删除该价位
+		if(level.empty()){
+			lv=levels.erase(lv);
+		}else{
+			lv++;
 		}
 	}
-	// 修改当前订单的数量
-	auto sellOrderQty=sellOrder.orderqty();
-	sellOrder.set_orderqty(sellOrderQty-cnt);
 	// 修改市价单的价格为市价
-	if(sellOrder.ordertype()==NewOrderRequest::MARKET){
-		sellOrder.set_price(market);
+	if(sellOrder.kind==KIND_MARKET){
+		sellOrder.price=book.marketPrice();
 	}
-	// 修改当前订单信息
-	alterOrder(orderID, sellOrder);
 }
 
-// 买订单操作
-void TradingMarket::buyOrders(const uint64_t& orderID, const std::string& stockID, 
-		std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
-	// 获取买订单
-	NewOrderRequest buyOrder=selectOrder(orderID);
-	// 记录成交的数量
-	uint32_t cnt=0; 
-	{
-		// 卖订单容器
-		auto& orderSet=getSellOrderSet(stockID);
-		// 遍历容器
-		for(auto it=orderSet.begin(); it!=orderSet.end();){
-			if(cnt>=buyOrder.orderqty()) break;
-			auto sellOrderID=*it;
-			auto sellOrder=selectOrder(sellOrderID);
+// 买订单操作: 从最优卖价开始逐档撮合, 遇到第一个不能成交的价位即停止
+void TradingMarket::buyOrders(const OrderHandle& handle, OrderBook& book,
+		std::vector<std::pair<SessionID, Execution> >& reports){
+	auto& pool=book.pool();
+	// 获取买订单, 成交数量直接在订单记录上修改
+	auto& buyOrder=pool.get(handle);
+	// 卖盘
+	auto& levels=book.asks();
+	for(auto lv=levels.begin(); lv!=levels.end()&&buyOrder.leaveQty>0;){
+		// 卖价高于买价, 后续价位均无法成交
+		if(buyOrder.price<lv->first) break;
+		auto fillPrice=lv->first;
+		// 同一价位按时间优先成交
+		auto& level=lv->second;
+		for(auto it=level.head; it!=NIL_HANDLE&&buyOrder.leaveQty>0;){
+			auto& sellOrder=pool.get(it);
+			// 先取出后一笔订单, 当前订单成交完后会被摘除
+			auto next=sellOrder.next;
 			// 不能与同一用户发布的订单进行交易
-			if(buyOrder.clientid()==sellOrder.clientid()){
-				it++;
-				continue;	
-			}
-			// 判断价格是否可以购买
-			if(buyOrder.price()<sellOrder.price()-MINN){
-				it++;
+			if(buyOrder.clientID==sellOrder.clientID){
+				it=next;
 				continue;
 			}
-			double fillPrice=sellOrder.price();
 			// 计算可购买的数量
-			auto tradNum=std::min(sellOrder.orderqty(), buyOrder.orderqty()-cnt);
-			cnt+=tradNum;
+			auto tradNum=std::min(sellOrder.leaveQty, buyOrder.leaveQty);
+			buyOrder.leaveQty-=tradNum;
+			sellOrder.leaveQty-=tradNum;
+			if(journal) journalFills.push_back(JournalFill{sellOrder.orderID, fillPrice, tradNum});
 			// 设置当前订单交易成功的应答
-			ExecutionReport report;
-			initReport(report, buyOrder);
-			report.set_stat(ExecutionReport::FILL);
-			report.set_orderid(orderID);
-			report.set_fillqty(tradNum);
-			report.set_fillprice(fillPrice);
-			report.set_leaveqty(buyOrder.orderqty()-cnt);
-			report.set_time(getTime());
+			Execution report;
+			initReport(report, handle, book);
+			report.fillQty=tradNum;
+			setFillPrice(report, fillPrice, book);
 			// 设置sell订单交易成功的应答
-			ExecutionReport report_;
-			initReport(report_, sellOrder);
-			report_.set_stat(ExecutionReport::FILL);
-			report_.set_orderid(sellOrderID);
-			report_.set_fillqty(tradNum);
-			report_.set_fillprice(fillPrice);
-			report_.set_leaveqty(sellOrder.orderqty()-tradNum);
-			report_.set_time(getTime());
-			// 从数据库中修改订单的库存量
-			auto num=sellOrder.orderqty();
-			sellOrder.set_orderqty(num-tradNum);
-			alterOrder(sellOrderID, sellOrder);
-			// 获取buy和sell order的stream
-			//auto& buyOrder_stream=orderID_stream[orderID];
-			//auto& sellOrder_stream=orderID_stream[sellOrderID];
+			Execution report_;
+			initReport(report_, it, book);
+			report_.fillQty=tradNum;
+			setFillPrice(report_, fillPrice, book);
 			// 发送report
-			reports.push_back(std::make_pair(orderID, report));
-			reports.push_back(std::make_pair(sellOrderID, report_));
-			//buyOrder_stream->Write(report);
-			//sellOrder_stream->Write(report_);
+			reports.push_back(std::make_pair(buyOrder.session, report));
+			reports.push_back(std::make_pair(sellOrder.session, report_));
 			// 判断订单的数量是否大于0
-			if(sellOrder.orderqty()==0){
-				orderSet.erase(it++);
-				deleteOrder(sellOrderID);
-			} 
-			else {
-				it++;
+			if(sellOrder.leaveQty==0){
+				book.unindexOrder(it);
+				book.unlink(it);
+				pool.release(it);
+			}else{
+				book.touchOrder(it);
 			}
+			it=next;
+		}
+		// 价位已无订单时删除该价位
+		if(level.empty()){
+			lv=levels.erase(lv);
+		}else{
+			lv++;
 		}
 	}
-	// 修改当前订单的数量
-	auto orderQty=buyOrder.orderqty();
-	buyOrder.set_orderqty(orderQty-cnt);
 	// 修改市价单的价格
-	if(buyOrder.ordertype()==NewOrderRequest::MARKET){
-		buyOrder.set_price(market);
+	if(buyOrder.kind==KIND_MARKET){
+		buyOrder.price=book.marketPrice();
 	}
-	// 修改当前订单信息
-	alterOrder(orderID, buyOrder);
 }
 
-// 创建订单
-uint64_t TradingMarket::createOrder(const NewOrderRequest& request){
-	// 为订单分配ID
-	uint64_t orderID;
-	{
-		// 加锁,保护订单编号动态增加,作用域结束自动解锁
-		std::unique_lock<std::mutex> lk(orderID_mutex);
-		orderID=++id;
-	}
-	// 将订单存入订单集合中
-	{
-		insertOrder(orderID, request);
-	}
-
-	// 获取订单对应的股票ID
-	std::string stockID=request.stockid();
-	// 为stockID分配容器对象和锁
-	if(!existInContainers(stockID)){
-		insertStock(stockID);
-	}
-	return orderID;
+// 在订单簿的订单池中创建订单
+OrderHandle TradingMarket::createOrder(OrderBook& book, const NewOrder& request, const int64_t& price, const SessionID& session){
+	// 从订单池中分配订单记录
+	auto handle=book.pool().allocate();
+	auto& order=book.pool().get(handle);
+	// 订单ID由订单簿分配, 编码了所属股票
+	order.orderID=book.nextOrderID();
+	order.clientID=request.clientID;
+	order.price=price;
+	order.time=time(NULL);
+	order.orderQty=request.orderQty;
+	order.leaveQty=request.orderQty;
+	order.side=request.side;
+	order.kind=request.kind;
+	order.session=session;
+	book.pool().clOrdID(handle)=request.clOrdID;
+	order.level=nullptr;
+	order.prev=order.next=NIL_HANDLE;
+	order.clientPrev=order.clientNext=NIL_HANDLE;
+	return handle;
 }
 
 /***************************************************************************************
                                  订单容器操作相关
 ****************************************************************************************/
-// 插入新订单
-void TradingMarket::insertOrder(const uint64_t& orderID, const NewOrderRequest& request){
-	// 加锁,保护hash表的增删
-	std::unique_lock<std::shared_mutex> w(rw_orders_mutex);
-	orders.insert(std::make_pair(orderID, request));
+// 从订单簿最近发布的快照中收集满足条件的挂单, 不访问订单簿的可变状态, 可在任意线程执行
+void TradingMarket::collectOrders(const OrderBook& book, const BookSnapshot& snapshot, const QueryFilter& filter, std::vector<OrderInfo>& reports){
+	// 从下界所在的页开始
+	uint64_t page=0;
+	if(orderSymbol(filter.lower)==book.symbol()){
+		page=(filter.lower&((1ull<<ORDER_SEQ_BITS)-1))>>SNAPSHOT_PAGE_BITS;
+	}
+	if(page<snapshot.firstPage) page=snapshot.firstPage;
+	// 收集一笔订单, 超出上界或填满一页时返回false
+	auto take=[&](const OrderView& order){
+		if(order.orderID>filter.upper) return false;
+		if((filter.side==FILTER_SELL&&order.side!=SIDE_SELL)
+				||(filter.side==FILTER_BUY&&order.side!=SIDE_BUY)) return true;
+		OrderInfo report;
+		initReport(report, order, book);
+		report.version=snapshot.version;
+		reports.push_back(report);
+		return reports.size()<filter.pageSize;
+	};
+	for(; page-snapshot.firstPage<snapshot.pages.size(); page++){
+		auto& rows=snapshot.pages[page-snapshot.firstPage];
+		if(rows==nullptr) continue;
+		if(filter.clientID>0){
+			// 按客户查询: 经客户索引只访问该客户在本页中不小于下界的订单
+			auto range=std::equal_range(rows->clients.begin(), rows->clients.end(), ClientRow(filter.clientID, 0),
+					[](const ClientRow& a, const ClientRow& b){return a.first<b.first;});
+			auto it=std::lower_bound(range.first, range.second, filter.lower,
+					[&](const ClientRow& row, const uint64_t& id){return rows->orders[row.second].orderID<id;});
+			for(; it!=range.second; ++it){
+				if(!take(rows->orders[it->second])) return;
+			}
+			continue;
+		}
+		auto it=std::lower_bound(rows->orders.begin(), rows->orders.end(), filter.lower,
+				[](const OrderView& order, const uint64_t& id){return order.orderID<id;});
+		for(; it!=rows->orders.end(); ++it){
+			if(!take(*it)) return;
+		}
+	}
 }
 
-// 修改订单
-void TradingMarket::alterOrder(const uint64_t& orderID, const NewOrderRequest& request){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_orders_mutex);
-	orders.at(orderID)=request;
-}
+/***************************************************************************************
+                                    股票容器操作相关
+****************************************************************************************/
 
-// 删除订单
-bool TradingMarket::deleteOrder(const uint64_t& orderID){
-	// 加锁,保护hash表的增删
-	std::unique_lock<std::shared_mutex> w(rw_orders_mutex);
-	if(orders.find(orderID)!=orders.end()){
-		orders.erase(orderID);
-		return true;
+// 启动分片撮合模式
+void TradingMarket::startMatchThreads(const uint32_t& n, const int& firstCpu){
+	if(n==0) return;
+	// 订单簿改由撮合线程访问, 快照也改由撮合线程发布
+	stopSnapshotThread();
+	unpublished.resize(n);
+	for(uint32_t i=0;i<n;i++){
+		shards.emplace_back(new MatchShard(SHARD_QUEUE_CAPACITY, [this, i](){
+			publishSnapshots(i);
+		}));
+		shards.back()->start(firstCpu>=0 ? firstCpu+(int)i: -1);
 	}
-	return false;
 }
 
-// 查询订单
-NewOrderRequest TradingMarket::selectOrder(const uint64_t& orderID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_orders_mutex);
-	return orders.at(orderID);
+// 写一次检查点
+bool TradingMarket::checkpoint(const CheckpointMode& mode){
+	if(!journal) return false;
+	return mode==CHECKPOINT_FORK ? forkCheckpoint(): copyCheckpoint();
 }
 
-// 判断订单存在
-bool TradingMarket::existInOrders(const uint64_t& orderID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_orders_mutex);
-	if(orders.find(orderID)!=orders.end()){
-		return true;
+// 复制方式写检查点
+bool TradingMarket::copyCheckpoint(){
+	auto begin=std::chrono::steady_clock::now();
+	std::vector<BookImage> images;
+	uint64_t orders=0, fromSeq;
+	{
+		// 持创建订单簿的锁取回放起点: 创建记录早于起点的订单簿都已发布, 下面的遍历不会漏掉
+		std::unique_lock<std::mutex> lk(books_mutex);
+		fromSeq=journal->nextSeq();
 	}
-	return false;
-}
-
-// 判断订单存在且获取订单
-bool TradingMarket::isExistAndGetOrder(const uint64_t& orderID, NewOrderRequest& order){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_orders_mutex);
-	if(orders.find(orderID)!=orders.end()){
-		order=orders.at(orderID);
-		return true;
+	uint64_t maxSeq=fromSeq;
+	for(SymbolID symbol=0;symbol<symbols.size();symbol++){
+		auto book=findOrderBook(symbol);
+		if(book==nullptr) continue;
+		images.emplace_back();
+		auto& image=images.back();
+		// 在订单簿所属的线程中复制挂单, 只暂停这一只股票
+		runOnBook(*book, [&](){
+			captureBook(*book, journal->nextSeq(), image);
+		});
+		orders+=image.orders.size();
+		maxSeq=std::max(maxSeq, image.book.journalSeq);
 	}
-	return false;
+	// 检查点中的状态必须都已在日志中落盘, 否则崩溃后日志会从更早的seq继续编号
+	journal->waitDurable(maxSeq);
+	if(!writeCheckpoint(checkpointPath, images, fromSeq)) return false;
+	auto millis=std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-begin).count();
+	std::cout<<"Checkpoint: "<<images.size()<<" books, "<<orders<<" orders, journal seq "<<fromSeq<<"-"<<maxSeq<<", "<<millis<<" ms"<<std::endl;
+	return true;
 }
 
-// 获取所有订单
-void TradingMarket::getAllOrders(std::vector<OrderReport>& reports){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_orders_mutex);
-	reports.reserve(orders.size());
-	for(const auto& [orderID, order]:orders){
-		OrderReport report;
-		initReport(report, order, orderID);
-		reports.push_back(report);
+// 暂停任务: 撮合线程执行到该任务时停下, 直到released被置位
+class PauseTask: public MatchTask{
+public:
+	PauseTask(std::atomic<uint32_t>& arrived, std::atomic<bool>& released):arrived_(arrived), released_(released){}
+	virtual void run() override {
+		arrived_.fetch_add(1, std::memory_order_acq_rel);
+		while(!released_.load(std::memory_order_acquire)) std::this_thread::yield();
 	}
-}
+private:
+	std::atomic<uint32_t>& arrived_;
+	std::atomic<bool>& released_;
+};
 
-/***************************************************************************************
-                                    股票容器操作相关
-****************************************************************************************/
-
-// 插入新股票
-void TradingMarket::insertStock(const std::string& stockID){
-	// 写锁
-	std::unique_lock<std::shared_mutex> w(rw_stocks_mutex);
-	if(sell_buy_containers.find(stockID)==sell_buy_containers.end()){
-		std::pair<std::mutex*, std::mutex*> sellAndBuyMutex;
-		sellAndBuyMutex.first=new std::mutex();
-		sellAndBuyMutex.second=new std::mutex();
-		stock_mutex.insert(std::make_pair(stockID, sellAndBuyMutex));
-		SellAndBuyContainer container;
-		sell_buy_containers.insert(std::make_pair(stockID, container));
+// 暂停全部订单簿后执行func
+template<typename F>
+void TradingMarket::runQuiesced(F&& func){
+	// 禁止创建新的订单簿
+	std::unique_lock<std::mutex> lk(books_mutex);
+	if(shards.empty()){
+		// 加锁模式: 按股票ID顺序锁住全部订单簿, 其他线程每次只持有一把订单簿锁, 不会死锁
+		std::vector<std::unique_lock<std::mutex> > locks;
+		for(SymbolID symbol=0;symbol<symbols.size();symbol++){
+			auto book=findOrderBook(symbol);
+			if(book!=nullptr) locks.emplace_back(book->mutex);
+		}
+		func();
+		return;
+	}
+	// 分片模式: 每个撮合线程执行一个暂停任务, 全部停下后它们的订单簿都不会再被修改
+	std::atomic<uint32_t> arrived(0);
+	std::atomic<bool> released(false);
+	std::vector<std::unique_ptr<PauseTask> > tasks;
+	for(auto& shard:shards){
+		tasks.emplace_back(new PauseTask(arrived, released));
+		shard->submit(tasks.back().get());
 	}
+	while(arrived.load(std::memory_order_acquire)<shards.size()) std::this_thread::yield();
+	func();
+	released.store(true, std::memory_order_release);
+	for(auto& task:tasks) task->wait();
 }
 
-// 将订单加入至待售卖容器
-void TradingMarket::addOrderToSell(const std::string& stockID, const uint64_t& orderID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_stocks_mutex);
-	sell_buy_containers.at(stockID).sell.emplace(orderID);
+// fork方式写检查点
+bool TradingMarket::forkCheckpoint(){
+	auto begin=std::chrono::steady_clock::now();
+	std::string tmp=checkpointPath+".tmp";
+	uint64_t seq=0;
+	pid_t pid=-1;
+	// 撮合只在暂停全部订单簿和fork期间停顿, 之后父子进程共享的内存页写时复制
+	runQuiesced([&](){
+		seq=journal->nextSeq();
+		pid=fork();
+		if(pid!=0) return;
+		// 子进程只有当前线程, 订单簿不会再被修改, 逐个生成映像写出后直接退出
+		CheckpointWriter writer;
+		bool ok=writer.open(tmp, seq);
+		BookImage image;
+		for(SymbolID symbol=0;ok&&symbol<symbols.size();symbol++){
+			auto book=findOrderBook(symbol);
+			if(book==nullptr) continue;
+			captureBook(*book, seq, image);
+			writer.add(image);
+		}
+		_exit(ok&&writer.finish() ? 0: 1);
+	});
+	auto paused=std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-begin).count();
+	if(pid<0){
+		std::cerr<<"checkpoint: fork failed: "<<strerror(errno)<<std::endl;
+		return false;
+	}
+	int status=0;
+	while(waitpid(pid, &status, 0)<0&&errno==EINTR){}
+	if(!WIFEXITED(status)||WEXITSTATUS(status)!=0){
+		std::cerr<<"checkpoint: cannot write "<<tmp<<std::endl;
+		unlink(tmp.c_str());
+		return false;
+	}
+	// 检查点中的状态必须都已在日志中落盘, 之后才能替换旧的检查点
+	journal->waitDurable(seq);
+	if(rename(tmp.c_str(), checkpointPath.c_str())!=0){
+		std::cerr<<"checkpoint: cannot write "<<checkpointPath<<": "<<strerror(errno)<<std::endl;
+		unlink(tmp.c_str());
+		return false;
+	}
+	auto millis=std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-begin).count();
+	// 检查点包含seq之前的全部日志记录, 日志中更早的记录不再需要
+	std::cout<<"Checkpoint (fork): covers journal seq <"<<seq<<", paused "<<paused<<" us, "<<millis<<" ms"<<std::endl;
+	return true;
 }
 
-// 将订单加入至待购买容器
-void TradingMarket::addOrderToBuy(const std::string& stockID, const uint64_t& orderID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_stocks_mutex);
-	sell_buy_containers.at(stockID).buy.emplace(orderID);
+// 启动检查点线程
+void TradingMarket::startCheckpoints(const uint32_t& seconds, const CheckpointMode& mode){
+	checkpointThread=std::thread([this, seconds, mode](){
+		// 上次检查点之后没有新的日志记录时跳过
+		uint64_t written=0;
+		std::unique_lock<std::mutex> lk(checkpointMutex);
+		while(!checkpointCv.wait_for(lk, std::chrono::seconds(seconds), [this](){return checkpointStop;})){
+			lk.unlock();
+			uint64_t seq=journal->nextSeq();
+			if(seq!=written&&checkpoint(mode)) written=seq;
+			lk.lock();
+		}
+	});
 }
 
-// 将订单从售卖容器中删除
-void TradingMarket::delOrderFromSell(const std::string& stockID, const uint64_t& orderID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_stocks_mutex);
-	if(sell_buy_containers.at(stockID).sell.find(orderID)!=sell_buy_containers.at(stockID).sell.end()){
-		sell_buy_containers.at(stockID).sell.erase(orderID);
+// 析构函数
+TradingMarket::~TradingMarket(){
+	// 先停止检查点线程和撮合线程, 再写完日志, 最后释放订单簿
+	{
+		std::unique_lock<std::mutex> lk(checkpointMutex);
+		checkpointStop=true;
 	}
-}
-
-// 将订单从购买容器中删除
-void TradingMarket::delOrderFromBuy(const std::string& stockID, const uint64_t& orderID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_stocks_mutex);
-	if(sell_buy_containers.at(stockID).buy.find(orderID)!=sell_buy_containers.at(stockID).buy.end()){
-		sell_buy_containers.at(stockID).buy.erase(orderID);
+	checkpointCv.notify_all();
+	if(checkpointThread.joinable()) checkpointThread.join();
+	stopSnapshotThread();
+	shards.clear();
+	journal.reset();
+	for(uint32_t i=0;i<MAX_STOCKS;i++){
+		delete books[i].load(std::memory_order_relaxed);
 	}
 }
 
-// 判断该股票订单是否在容器中
-bool TradingMarket::existInContainers(const std::string& stockID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_stocks_mutex);
-	if(sell_buy_containers.find(stockID)!=sell_buy_containers.end()){
-		return true;
+// 获取股票ID对应的订单簿, 不存在时创建
+OrderBook& TradingMarket::getOrderBook(const SymbolID& symbol, const std::string& stockID){
+	auto book=books[symbol].load(std::memory_order_acquire);
+	if(book!=nullptr) return *book;
+	// 加锁, 保护订单簿的创建
+	std::unique_lock<std::mutex> lk(books_mutex);
+	book=books[symbol].load(std::memory_order_relaxed);
+	if(book==nullptr){
+		auto it=tick_sizes.find(stockID);
+		double tickSize=it!=tick_sizes.end() ? it->second: DEFAULT_TICK_SIZE;
+		book=createOrderBook(symbol, stockID, tickSize);
+		if(shards.empty()&&!snapshotThread.joinable()) startSnapshotThread();
 	}
-	return false;
+	return *book;
 }
 
-// 获取卖订单集合的引用
-std::set<uint64_t>& TradingMarket::getSellOrderSet(const std::string& stockID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_stocks_mutex);
-	return sell_buy_containers.at(stockID).sell;
+// 创建订单簿并发布
+OrderBook* TradingMarket::createOrderBook(const SymbolID& symbol, const std::string& stockID, const double& tickSize){
+	auto book=new OrderBook(symbol, stockID, tickSize, market, sessionOrders_.get());
+	// 先记录订单簿, 之后该股票的记录都排在它后面
+	if(journal) journal->book(symbol, stockID, tickSize);
+	books[symbol].store(book, std::memory_order_release);
+	return book;
 }
 
-// 获取买订单集合的引用
-std::set<uint64_t>& TradingMarket::getBuyOrderSet(const std::string& stockID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_stocks_mutex);
-	return sell_buy_containers.at(stockID).buy;
+// 设置股票的最小变动价位
+bool TradingMarket::setTickSize(const std::string& stockID, const double& tickSize){
+	auto symbol=symbols.intern(stockID);
+	if(tickSize<=0||symbol==INVALID_SYMBOL) return false;
+	// 加锁, 保护订单簿的创建
+	std::unique_lock<std::mutex> lk(books_mutex);
+	if(books[symbol].load(std::memory_order_relaxed)!=nullptr) return false;
+	tick_sizes[stockID]=tickSize;
+	return true;
 }
 #endif
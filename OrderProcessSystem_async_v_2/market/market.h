@@ -11,39 +11,50 @@
 #include <utility>
 #include <shared_mutex>
 #include <thread>
-#include "../helper/helper.h"
+#include <memory>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include "market_types.h"
+#include "order_book.h"
+#include "symbol_table.h"
+#include "match_shard.h"
+#include "journal.h"
 
-#include <grpc/grpc.h>
-#include <grpcpp/server.h>
-#include <grpcpp/server_builder.h>
-#include <grpcpp/server_context.h>
-#include <grpcpp/security/server_credentials.h>
-#include "../proto/OrderProcessSystem.grpc.pb.h"
+// 默认最小变动价位
+const double DEFAULT_TICK_SIZE=0.01;
+// 最大股票数量
+const uint32_t MAX_STOCKS=1u<<16;
+// 每个撮合线程任务队列的容量
+const size_t SHARD_QUEUE_CAPACITY=4096;
+// 查询订单每页的最大订单数
+const uint32_t MAX_QUERY_PAGE=1000;
+// 加锁模式下发布订单簿快照的间隔(微秒)
+const uint32_t SNAPSHOT_PUBLISH_MICROS=1000;
 
-using grpc::Server;
-using grpc::ServerBuilder;
-using grpc::ServerContext;
-using grpc::ServerReader;
-using grpc::ServerReaderWriter;
-using grpc::ServerWriter;
-using grpc::Status;
-
-using OPS::NewOrderRequest;
-using OPS::CancelOrderRequest;
-using OPS::QueryOrderRequest;
-using OPS::ExecutionReport;
-using OPS::OrderReport;
-using OPS::OrderService;
-
-const double MINN=1e-6;
+// 检查点方式
+enum CheckpointMode{
+	// 逐个订单簿在其所属线程中复制挂单, 由检查点线程写文件
+	CHECKPOINT_COPY,
+	// 暂停全部订单簿后fork, 子进程从写时复制的内存中写文件, 父进程立即恢复撮合
+	CHECKPOINT_FORK
+};
 
-// 售卖容器和购买容器
-struct SellAndBuyContainer{
-	std::set<uint64_t> sell;
-	std::set<uint64_t> buy;
+// 查询条件: 订单ID范围为闭区间[lower, upper]
+struct QueryFilter{
+	uint64_t clientID;
+	SideFilter side;
+	uint64_t lower;
+	uint64_t upper;
+	size_t pageSize;
 };
 
+// 应答回调: 参数为一次操作在订单簿中产生的应答及其个数, 以及这些应答的日志记录落盘所需等待的seq
+// 在订单簿所属的线程中(加锁模式持订单簿锁)调用, 同一订单簿的应答按撮合顺序到达
+typedef std::function<void(const std::pair<SessionID, Execution>*, const size_t&, const uint64_t&)> ReportSink;
+
 // 交易市场：单例模式 饿汉模式 无线程安全问题
+// 撮合核心(静态库ops_market)只使用market_types.h中的结构体, 不依赖gRPC和protobuf
 class TradingMarket{
 public:
 	// 获取实例
@@ -51,83 +62,144 @@ public:
 		//if(m_instance==NULL) m_instance=new TradingMarket();
 		return m_instance;
 	}
-	// 根据新订单请求做出应答消息
-	void processNewOrder(const NewOrderRequest&, std::vector<std::pair<uint64_t, ExecutionReport> >&, uint64_t&);
-	// 根据撤销订单请求做出应答消息
-	void processCancelOrder(const CancelOrderRequest&, ExecutionReport&);
-	// 根据查询订单请求做出应答消息
-	void processQueryOrder(const QueryOrderRequest&, std::vector<OrderReport>&);
+	// 以下三个接口的应答与会话ID成对返回, 会话ID为NO_SESSION的应答是只发给请求方的拒绝
+	// 设置了应答回调时, 在订单簿中产生的应答还在订单簿所属的线程中交给应答回调, 调用者只需处理NO_SESSION的应答
+	// 根据新订单请求做出应答消息, 订单记录所属会话
+	void processNewOrder(const NewOrder&, const SessionID&, std::vector<std::pair<SessionID, Execution> >&, uint64_t&);
+	// 撤销订单ID对应的订单, session返回订单所属会话(撤单失败时为NO_SESSION)
+	void processCancelOrder(const uint64_t&, Execution&, SessionID&);
+	// 根据改单请求做出应答消息, 改价后的撮合结果一并返回
+	void processAmendOrder(const AmendOrder&, std::vector<std::pair<SessionID, Execution> >&);
+	// 根据批量撤单请求撤销客户的挂单, 每个订单簿只处理一次
+	void processMassCancel(const MassCancel&, MassCancelResult&);
+	// 撤销会话中给定客户的全部挂单(会话断开时使用), 其他会话提交的订单不受影响
+	void cancelSessionOrders(const SessionID&, const std::set<uint64_t>&, MassCancelResult&);
+	// 根据查询请求做出应答消息: 按订单ID从小到大返回一页满足条件的挂单
+	void processQueryOrder(const OrderQuery&, std::vector<OrderInfo>&);
+	// 设置应答回调, 需在处理任何请求之前调用
+	void setReportSink(ReportSink sink){reportSink=std::move(sink);}
+	// 设置股票的最小变动价位, 只能在该股票第一笔订单之前设置(设置成功返回true)
+	bool setTickSize(const std::string&, const double&);
+	// 启动分片撮合模式：股票按ID分配到n个撮合线程, 每个线程独占其订单簿
+	// 需在处理任何请求之前调用; 不调用时为加锁模式, 由接收请求的线程持订单簿锁撮合
+	// firstCpu不小于0时, 第i个撮合线程绑定到第firstCpu+i个CPU
+	void startMatchThreads(const uint32_t&, const int& firstCpu=-1);
+	// 启用预写日志: 接受的订单、成交、撤单和改单按执行顺序追加到日志文件
+	// 先从最新的检查点批量重建订单簿, 再回放检查点之后的日志, 最后打开日志继续追加
+	// 需在处理任何请求和startMatchThreads之前调用, commitMicros为组提交间隔(微秒), 失败返回false
+	bool openJournal(const std::string&, const uint32_t&);
+	// 写一次检查点(需先启用日志), 写文件不占用撮合线程
+	bool checkpoint(const CheckpointMode& mode=CHECKPOINT_COPY);
+	// 启动检查点线程, 每隔seconds秒写一次检查点, 需在startMatchThreads之后调用
+	void startCheckpoints(const uint32_t& seconds, const CheckpointMode& mode=CHECKPOINT_COPY);
+	// 日志中下一个分配的seq, 未启用日志时为0: 处理返回之后读取时, 该处理写入的日志记录seq都小于它
+	uint64_t journalSeq() const {return journal ? journal->nextSeq(): 0;}
+	// 等待seq之前的日志记录全部落盘, 未启用日志时立即返回
+	void waitDurable(const uint64_t& seq){if(journal) journal->waitDurable(seq);}
+	// 会话在所有订单簿中的挂单数
+	uint32_t sessionOrders(const SessionID& session) const {
+		return sessionOrders_[session].load(std::memory_order_acquire);
+	}
 private:
 	// 构造函数
-	TradingMarket(){
-		id=0;
+	TradingMarket():symbols(MAX_STOCKS), books(new std::atomic<OrderBook*>[MAX_STOCKS]),
+			sessionOrders_(new std::atomic<uint32_t>[MAX_SESSIONS]){
 		market=5.0;
+		checkpointStop=false;
+		snapshotStop=false;
+		for(uint32_t i=0;i<MAX_STOCKS;i++) books[i].store(nullptr, std::memory_order_relaxed);
+		for(uint32_t i=0;i<MAX_SESSIONS;i++) sessionOrders_[i].store(0, std::memory_order_relaxed);
 	}
+public:
+	// 析构函数
+	~TradingMarket();
+private:
 	// 实例
 	static TradingMarket* m_instance;
 
-	// 存放订单的容器<orderID, order>, 插入与删除需要互斥
-	std::unordered_map<uint64_t, NewOrderRequest> orders; 
-	// <orderID, order_mutex>, 插入与删除需要互斥
-	//std::unordered_map<uint64_t, std::mutex*> order_mutex;
-	// 插入和删除订单容器的互斥量
-	std::shared_mutex rw_orders_mutex;
-
-	// 需要被售卖或购买的容器，<stockID, sell and buy container>, 插入与删除需要互斥
-	std::unordered_map<std::string, SellAndBuyContainer> sell_buy_containers;
-	// <stockID, pair<first: sell_mutex, second: buy_mutex> >, 插入与删除需要互斥
-	std::unordered_map<std::string, std::pair<std::mutex*, std::mutex*> > stock_mutex; 
-	// 插入和删除股票容器的互斥量
-	std::shared_mutex rw_stocks_mutex;
+	// 股票代码表：请求进入市场时将股票代码转换为整数ID, 之后只使用整数ID
+	SymbolTable symbols;
+	// 订单簿数组, 下标为股票ID, 订单簿创建后不再改变, 查找无需加锁
+	std::unique_ptr<std::atomic<OrderBook*>[]> books;
+	// 每只股票的最小变动价位，<stockID, tick size>, 未设置的股票使用默认值
+	std::unordered_map<std::string, double> tick_sizes;
+	// 创建订单簿的互斥量
+	std::mutex books_mutex;
+	// 各会话的挂单数, 下标为会话ID
+	std::unique_ptr<std::atomic<uint32_t>[]> sessionOrders_;
 
-	// 删除操作之间互斥
-	std::shared_mutex cancel_mutex;
-
-	// 订单ID，动态增加，增加需要互斥
-	uint64_t id;
-	// 订单ID增加的互斥锁
-	std::mutex orderID_mutex;
+	// 撮合分片, 为空时为加锁模式
+	std::vector<std::unique_ptr<MatchShard> > shards;
+	// 各撮合线程上次发布快照之后修改过的订单簿, 只由该撮合线程访问
+	std::vector<std::vector<OrderBook*> > unpublished;
+	// 发布撮合线程修改过的订单簿的快照(在该撮合线程中执行)
+	void publishSnapshots(const size_t&);
+	// 在订单簿所属的线程中执行操作: 分片模式交给撮合线程执行, 加锁模式持订单簿锁执行
+	template<typename F>
+	void runOnBook(OrderBook&, F&&);
+	// 快照由撮合一方发布, 查询只读取已发布的快照:
+	// 分片模式由撮合线程在队列取空时批量发布; 加锁模式由快照线程定期持订单簿锁发布有变化的订单簿
+	// 快照线程在处理请求时创建第一个订单簿或恢复订单簿之后启动, 启动分片撮合时停止
+	std::thread snapshotThread;
+	std::mutex snapshotMutex;
+	std::condition_variable snapshotCv;
+	bool snapshotStop;
+	void startSnapshotThread();
+	void stopSnapshotThread();
+	// 预写日志, 为空时不记录
+	std::unique_ptr<Journal> journal;
+	// 检查点文件
+	std::string checkpointPath;
+	// 检查点线程及其停止标志
+	std::thread checkpointThread;
+	std::mutex checkpointMutex;
+	std::condition_variable checkpointCv;
+	bool checkpointStop;
+	// 复制方式写检查点: 各订单簿的映像对应不同的日志seq
+	bool copyCheckpoint();
+	// fork方式写检查点: 全部订单簿对应同一个日志seq
+	bool forkCheckpoint();
+	// 暂停全部订单簿(都处于两次操作之间)后执行func, 期间不能创建新的订单簿
+	template<typename F>
+	void runQuiesced(F&&);
+	// 回放一条日志记录(启动时单线程执行), covered[i]之前的记录已包含在股票i的检查点映像中
+	bool replayRecord(const JournalRecord&, const std::string&, const std::vector<uint64_t>& covered);
+	// 创建订单簿并发布(调用者保证该股票尚无订单簿)
+	OrderBook* createOrderBook(const SymbolID&, const std::string&, const double&);
 
 	// 市场价
 	double market; 
+	// 应答回调, 为空时不调用
+	ReportSink reportSink;
+	// 将一次操作在订单簿中产生的应答交给应答回调(在订单簿所属的线程中执行)
+	void emitReports(const std::pair<SessionID, Execution>*, const size_t&);
 
-	// 创建订单
-	uint64_t createOrder(const NewOrderRequest&);
-	// 插入新订单
-	void insertOrder(const uint64_t&, const NewOrderRequest&);
-	// 修改订单
-	void alterOrder(const uint64_t&, const NewOrderRequest&);
-	// 删除订单(删除成功返回true)
-	bool deleteOrder(const uint64_t&);
+	// 新订单撮合与挂单(在订单簿所属的线程中执行)
+	void matchNewOrder(OrderBook&, const NewOrder&, const int64_t&, const SessionID&, std::vector<std::pair<SessionID, Execution> >&, uint64_t&);
+	// 从订单簿中撤销订单(在订单簿所属的线程中执行)
+	void cancelOrder(OrderBook&, const uint64_t&, Execution&, SessionID&);
+	// 修改订单的数量和价格(在订单簿所属的线程中执行)
+	void amendOrder(OrderBook&, const uint64_t&, const uint32_t&, const int64_t&, Execution&, std::vector<std::pair<SessionID, Execution> >&);
+	// 撤销客户在订单簿中的挂单, session不为NO_SESSION时只撤该会话提交的订单(在订单簿所属的线程中执行)
+	void cancelClientOrders(OrderBook&, const uint64_t&, const SideFilter&, MassCancelResult&, const SessionID& session=NO_SESSION);
+	// 订单撮合后剩余数量挂入订单簿(挂单返回true), 全部成交则释放订单
+	bool restOrder(OrderBook&, const OrderHandle&);
+	// 在订单簿的订单池中创建订单
+	OrderHandle createOrder(OrderBook&, const NewOrder&, const int64_t&, const SessionID&);
 	// 卖订单
-	void sellOrders(const uint64_t&, const std::string&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
+	void sellOrders(const OrderHandle&, OrderBook&, std::vector<std::pair<SessionID, Execution> >&);
 	// 买订单
-	void buyOrders(const uint64_t&, const std::string&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
-	// 查询订单
-	NewOrderRequest selectOrder(const uint64_t&);
-	// 判断订单存在
-	bool existInOrders(const uint64_t&);
-	// 判断订单存在且获取订单
-	bool isExistAndGetOrder(const uint64_t&, NewOrderRequest&);
-	// 获取所有订单
-	void getAllOrders(std::vector<OrderReport>&);
+	void buyOrders(const OrderHandle&, OrderBook&, std::vector<std::pair<SessionID, Execution> >&);
+	// 从订单簿最近发布的快照中收集满足条件的挂单, 直到填满一页(可在任意线程执行)
+	void collectOrders(const OrderBook&, const BookSnapshot&, const QueryFilter&, std::vector<OrderInfo>&);
 
-	// 插入新股票
-	void insertStock(const std::string&);
-	// 将订单加入至待售卖容器
-	void addOrderToSell(const std::string&, const uint64_t&);
-	// 将订单加入至待购买容器
-	void addOrderToBuy(const std::string&, const uint64_t&);
-	// 将订单从售卖容器中删除
-	void delOrderFromSell(const std::string&, const uint64_t&);
-	// 将订单从购买容器中删除
-	void delOrderFromBuy(const std::string&, const uint64_t&);
-	// 判断该股票订单是否在容器中
-	bool existInContainers(const std::string&);
-	// 获取订单集合的引用
-	std::set<uint64_t>& getSellOrderSet(const std::string&);
-	// 获取买订单集合的引用
-	std::set<uint64_t>& getBuyOrderSet(const std::string&);
+	// 获取股票ID对应的订单簿, 不存在时创建
+	OrderBook& getOrderBook(const SymbolID&, const std::string&);
+	// 获取股票ID对应的订单簿, 不存在时返回nullptr
+	OrderBook* findOrderBook(const SymbolID& symbol){
+		if(symbol>=symbols.size()) return nullptr;
+		return books[symbol].load(std::memory_order_acquire);
+	}
 };
 // TradingMarket* TradingMarket::m_instance=new TradingMarket;
 #endif
@@ -0,0 +1,122 @@
+#ifndef MARKET_TYPES_H
+#define MARKET_TYPES_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "order_pool.h"
+
+// 撮合核心的请求与应答：普通结构体, 不依赖gRPC和protobuf
+// 服务端由适配层(adapter/market_adapter.h)在protobuf消息与这些结构体之间转换
+
+// 新订单
+struct NewOrder{
+	uint64_t clientID=0;
+	OrderSide side=SIDE_SELL;
+	OrderKind kind=KIND_LIMIT;
+	std::string stockID;
+	uint32_t orderQty=0;
+	// 报单价格
+	double price=0;
+	// 报单价格(以最小变动价位为单位的整数), 非0时优先于price
+	int64_t priceTicks=0;
+	// 客户订单ID, 在该订单的全部执行结果中回传
+	uint64_t clOrdID=0;
+};
+
+// 改单: 数量或价格为0表示不修改
+struct AmendOrder{
+	uint64_t orderID=0;
+	// 新的订单总量(含已成交部分)
+	uint32_t orderQty=0;
+	double price=0;
+	// 非0时优先于price
+	int64_t priceTicks=0;
+};
+
+// 批量撤单和查询的买卖方向过滤(与MassCancelRequest/QueryOrderRequest中的枚举取值一致)
+enum SideFilter : uint8_t {FILTER_BOTH=0, FILTER_SELL=1, FILTER_BUY=2};
+
+// 批量撤单
+struct MassCancel{
+	uint64_t clientID=0;
+	// 为空时撤销所有股票的挂单
+	std::string stockID;
+	SideFilter side=FILTER_BOTH;
+};
+
+// 查询挂单
+struct OrderQuery{
+	// 0表示不过滤
+	uint64_t clientID=0;
+	// 为空时不过滤
+	std::string stockID;
+	SideFilter side=FILTER_BOTH;
+	// 订单ID范围(闭区间), 0表示不限
+	uint64_t minOrderID=0;
+	uint64_t maxOrderID=0;
+	// 每页订单数, 0或超过上限时使用上限
+	uint32_t pageSize=0;
+	// 只返回订单ID大于cursor的订单
+	uint64_t cursor=0;
+};
+
+// 执行结果状态(与ExecutionReport::STAT取值一致)
+enum ExecStatus : uint8_t {
+	EXEC_ACCEPT=0,
+	EXEC_REJECT=1,
+	EXEC_FILL=2,
+	EXEC_CANCELED=3,
+	EXEC_CANCEL_REJECT=4,
+	EXEC_REPLACED=5,
+	EXEC_REPLACE_REJECT=6
+};
+
+// 执行结果
+struct Execution{
+	ExecStatus stat=EXEC_REJECT;
+	uint64_t clientID=0;
+	uint64_t orderID=0;
+	uint64_t clOrdID=0;
+	std::string stockID;
+	uint32_t orderQty=0;
+	double orderPrice=0;
+	int64_t orderPriceTicks=0;
+	uint32_t fillQty=0;
+	double fillPrice=0;
+	int64_t fillPriceTicks=0;
+	uint32_t leaveQty=0;
+	// 错误信息(静态字符串), 成功时为nullptr
+	const char* error=nullptr;
+	// 处理时间(秒), 由适配层格式化, 撮合路径上不做字符串格式化
+	int64_t time=0;
+};
+
+// 批量撤单结果
+struct MassCancelResult{
+	uint64_t clientID=0;
+	uint32_t canceledOrders=0;
+	// 撤销的订单剩余数量之和
+	uint64_t canceledQty=0;
+	std::vector<uint64_t> orderIDs;
+	const char* error=nullptr;
+	int64_t time=0;
+};
+
+// 查询到的挂单
+struct OrderInfo{
+	uint64_t orderID=0;
+	uint64_t clientID=0;
+	OrderSide side=SIDE_SELL;
+	OrderKind kind=KIND_LIMIT;
+	std::string stockID;
+	// 剩余数量
+	uint32_t orderQty=0;
+	double price=0;
+	int64_t priceTicks=0;
+	int64_t time=0;
+	// 订单所在订单簿快照的版本号
+	uint64_t version=0;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef MATCH_SHARD_CC
+#define MATCH_SHARD_CC
+#include "match_shard.h"
+#include <chrono>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// 空闲时自旋的次数, 超过后休眠
+static const int SPIN_LIMIT=4096;
+// 持续繁忙时每执行多少个任务调用一次drained
+static const int DRAIN_BATCH=256;
+
+// 将线程绑定到指定CPU
+bool pinThread(std::thread& thread, const int& cpu){
+#ifdef __linux__
+	int n=std::thread::hardware_concurrency();
+	if(n<=0) return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu%n, &set);
+	return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set)==0;
+#else
+	return false;
+#endif
+}
+
+// 等待任务完成: 先自旋, 再让出CPU
+void MatchTask::wait(){
+	for(int i=0;!done_.load(std::memory_order_acquire);i++){
+		if(i>=SPIN_LIMIT) std::this_thread::yield();
+	}
+}
+
+MatchShard::MatchShard(const size_t& capacity, std::function<void()> drained):
+	inbox_(capacity), drained_(std::move(drained)), running_(false), sleeping_(false){}
+
+MatchShard::~MatchShard(){
+	stop();
+}
+
+// 启动撮合线程
+void MatchShard::start(const int& cpu){
+	running_.store(true);
+	thread_=std::thread(&MatchShard::loop, this);
+	if(cpu>=0) pinThread(thread_, cpu);
+}
+
+// 停止撮合线程
+void MatchShard::stop(){
+	if(!running_.exchange(false)) return;
+	{
+		std::unique_lock<std::mutex> lk(mutex_);
+		cv_.notify_one();
+	}
+	thread_.join();
+}
+
+// 提交任务
+void MatchShard::submit(MatchTask* task){
+	while(!inbox_.push(task)){
+		std::this_thread::yield();
+	}
+	// 撮合线程正在休眠时唤醒
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(sleeping_.load()){
+		std::unique_lock<std::mutex> lk(mutex_);
+		cv_.notify_one();
+	}
+}
+
+// 撮合线程主循环
+void MatchShard::loop(){
+	int idle=0;
+	// 上次调用drained之后执行的任务数
+	int executed=0;
+	MatchTask* task;
+	for(;;){
+		if(inbox_.pop(task)){
+			task->run();
+			task->finish();
+			idle=0;
+			if(++executed>=DRAIN_BATCH&&drained_){
+				drained_();
+				executed=0;
+			}
+			continue;
+		}
+		if(executed>0&&drained_){
+			drained_();
+			executed=0;
+		}
+		if(!running_.load()) break;
+		if(++idle<SPIN_LIMIT) continue;
+		// 长时间空闲: 先声明休眠再检查队列, 与submit中的检查配合保证不会丢失唤醒
+		std::unique_lock<std::mutex> lk(mutex_);
+		sleeping_.store(true);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(inbox_.empty()&&running_.load()){
+			cv_.wait_for(lk, std::chrono::milliseconds(1));
+		}
+		sleeping_.store(false);
+		idle=0;
+	}
+}
+#endif
@@ -0,0 +1,70 @@
+#ifndef MATCH_SHARD_H
+#define MATCH_SHARD_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "../helper/ring_buffer.h"
+
+// 将线程绑定到指定CPU, 仅支持Linux, 绑定成功返回true
+bool pinThread(std::thread&, const int&);
+
+// 撮合任务：由接收请求的线程创建, 交给订单簿所属的撮合线程执行
+class MatchTask{
+public:
+	MatchTask():done_(false){}
+	virtual ~MatchTask(){}
+	// 在撮合线程中执行
+	virtual void run()=0;
+	// 标记任务完成(撮合线程调用)
+	void finish(){done_.store(true, std::memory_order_release);}
+	// 等待任务完成(提交任务的线程调用)
+	void wait();
+private:
+	std::atomic<bool> done_;
+};
+
+// 以可调用对象实现的撮合任务
+template<typename F>
+class CallableTask: public MatchTask{
+public:
+	explicit CallableTask(F& func):func_(func){}
+	virtual void run() override {func_();}
+private:
+	F& func_;
+};
+
+// 撮合分片：一个撮合线程独占若干只股票的订单簿, 其他线程通过无锁队列提交任务
+// 同一只股票的所有请求都在同一个线程中按提交顺序执行, 订单簿无需加锁
+// drained在撮合线程中执行: 队列取空时执行一次, 持续繁忙时每执行DRAIN_BATCH个任务执行一次
+class MatchShard{
+public:
+	explicit MatchShard(const size_t& capacity, std::function<void()> drained=nullptr);
+	~MatchShard();
+	// 启动撮合线程, cpu不小于0时将线程绑定到该CPU
+	void start(const int& cpu=-1);
+	// 停止撮合线程(队列中剩余的任务会先执行完)
+	void stop();
+	// 提交任务, 队列已满时让出CPU等待
+	void submit(MatchTask*);
+	// 提交任务并等待执行完成
+	void execute(MatchTask* task){
+		submit(task);
+		task->wait();
+	}
+private:
+	// 撮合线程主循环
+	void loop();
+	RingBuffer<MatchTask*> inbox_;
+	std::function<void()> drained_;
+	std::thread thread_;
+	std::atomic<bool> running_;
+	// 撮合线程空闲时休眠, 提交任务时唤醒
+	std::atomic<bool> sleeping_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+};
+
+#endif
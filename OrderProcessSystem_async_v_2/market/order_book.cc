@@ -0,0 +1,190 @@
+#ifndef ORDER_BOOK_CC
+#define ORDER_BOOK_CC
+#include "order_book.h"
+
+// 将订单链接到价格档位的队尾
+static void linkTail(OrderPool& pool, PriceLevel& level, const OrderHandle& handle){
+	auto& order=pool.get(handle);
+	order.level=&level;
+	order.prev=level.tail;
+	order.next=NIL_HANDLE;
+	if(level.tail==NIL_HANDLE){
+		level.head=handle;
+	}else{
+		pool.get(level.tail).next=handle;
+	}
+	level.tail=handle;
+}
+
+// 登记挂单
+void OrderBook::indexOrder(const OrderHandle& handle){
+	auto& order=pool_.get(handle);
+	orders_[order.orderID]=handle;
+	byID_.push_back(OrderEntry{order.orderID, handle});
+	touchOrder(handle);
+	if(sessionOrders_!=nullptr&&order.session!=NO_SESSION){
+		sessionOrders_[order.session].fetch_add(1, std::memory_order_relaxed);
+	}
+	// 插入客户挂单链表的表头
+	auto it=clients_.find(order.clientID);
+	order.clientPrev=NIL_HANDLE;
+	if(it==clients_.end()){
+		order.clientNext=NIL_HANDLE;
+		clients_.insert(std::make_pair(order.clientID, handle));
+	}else{
+		order.clientNext=it->second;
+		pool_.get(it->second).clientPrev=handle;
+		it->second=handle;
+	}
+}
+
+// 删除挂单的登记
+void OrderBook::unindexOrder(const OrderHandle& handle){
+	auto& order=pool_.get(handle);
+	orders_.erase(order.orderID);
+	touchOrder(handle);
+	if(sessionOrders_!=nullptr&&order.session!=NO_SESSION){
+		sessionOrders_[order.session].fetch_sub(1, std::memory_order_release);
+	}
+	// 失效条目超过一半时压缩按订单ID排序的登记
+	if(++dead_>byID_.size()/2&&dead_>=64){
+		byID_.erase(std::remove_if(byID_.begin(), byID_.end(), [this](const OrderEntry& entry){
+			return orders_.find(entry.orderID)==orders_.end();
+		}), byID_.end());
+		dead_=0;
+	}
+	// 从客户挂单链表中摘除, 链表为空时删除该客户
+	if(order.clientPrev==NIL_HANDLE){
+		if(order.clientNext==NIL_HANDLE){
+			clients_.erase(order.clientID);
+		}else{
+			clients_[order.clientID]=order.clientNext;
+		}
+	}else{
+		pool_.get(order.clientPrev).clientNext=order.clientNext;
+	}
+	if(order.clientNext!=NIL_HANDLE){
+		pool_.get(order.clientNext).clientPrev=order.clientPrev;
+	}
+	order.clientPrev=order.clientNext=NIL_HANDLE;
+}
+
+// 标记挂单所在的快照页需要重建
+void OrderBook::touchOrder(const OrderHandle& handle){
+	uint64_t page=(pool_.get(handle).orderID&((1ull<<ORDER_SEQ_BITS)-1))>>SNAPSHOT_PAGE_BITS;
+	if(page>=dirty_.size()) dirty_.resize(page+1, false);
+	if(!dirty_[page]){
+		dirty_[page]=true;
+		dirtyPages_.push_back(page);
+	}
+	version_.store(version_.load(std::memory_order_relaxed)+1, std::memory_order_release);
+}
+
+// 重建变化的页并发布新快照
+void OrderBook::publishSnapshot(){
+	auto old=std::atomic_load(&snapshot_);
+	if(old!=nullptr&&old->version==version()) return;
+	auto next=std::make_shared<BookSnapshot>();
+	next->version=version();
+	// 复制页指针, 未变化的页与旧快照共享
+	uint64_t lastPage=seq_>>SNAPSHOT_PAGE_BITS;
+	next->firstPage=old!=nullptr ? old->firstPage: 0;
+	if(old!=nullptr) next->pages=old->pages;
+	next->pages.resize(lastPage+1-next->firstPage);
+	// 只重建变化的页
+	for(auto page:dirtyPages_){
+		dirty_[page]=false;
+		if(page<next->firstPage) continue;
+		auto begin=makeOrderID(symbol_, page<<SNAPSHOT_PAGE_BITS);
+		auto end=makeOrderID(symbol_, (page+1)<<SNAPSHOT_PAGE_BITS);
+		auto rows=std::make_shared<SnapshotPage>();
+		forEachOrderFrom(begin, [&](const OrderHandle& handle){
+			auto& order=pool_.get(handle);
+			if(order.orderID>=end) return false;
+			rows->orders.push_back(OrderView{order.orderID, order.clientID, order.price, order.time, order.leaveQty, order.side, order.kind});
+			return true;
+		});
+		// 行已按订单ID排序, 按<客户ID, 下标>排序后同一客户的订单仍按订单ID排列
+		rows->clients.reserve(rows->orders.size());
+		for(uint32_t row=0;row<rows->orders.size();row++){
+			rows->clients.push_back(ClientRow(rows->orders[row].clientID, row));
+		}
+		std::sort(rows->clients.begin(), rows->clients.end());
+		next->pages[page-next->firstPage]=rows->orders.empty() ? nullptr: std::shared_ptr<const SnapshotPage>(rows);
+	}
+	dirtyPages_.clear();
+	// 去掉开头没有挂单的页, 快照大小只与仍有挂单的序号区间有关
+	size_t skip=0;
+	while(skip+1<next->pages.size()&&next->pages[skip]==nullptr) skip++;
+	if(skip>0){
+		next->pages.erase(next->pages.begin(), next->pages.begin()+skip);
+		next->firstPage+=skip;
+	}
+	std::atomic_store(&snapshot_, std::shared_ptr<const BookSnapshot>(next));
+	published_.store(next->version, std::memory_order_release);
+}
+
+// 客户在本订单簿中的第一笔挂单
+OrderHandle OrderBook::firstClientOrder(const uint64_t& clientID) const {
+	auto it=clients_.find(clientID);
+	return it==clients_.end() ? NIL_HANDLE: it->second;
+}
+
+// 价格换算: 显示价格 -> 整数价位
+bool OrderBook::toTicks(const double& price, int64_t& ticks) const {
+	ticks=std::llround(price/tickSize_);
+	// 允许浮点表示误差, 但不允许偏离价位
+	return std::fabs(ticks*tickSize_-price)<=tickSize_*1e-6;
+}
+
+// 查找挂单的句柄
+bool OrderBook::findOrder(const uint64_t& orderID, OrderHandle& handle) const {
+	auto it=orders_.find(orderID);
+	if(it==orders_.end()) return false;
+	handle=it->second;
+	return true;
+}
+
+// 将订单挂入卖盘
+void OrderBook::addAsk(const int64_t& price, const OrderHandle& handle){
+	linkTail(pool_, asks_[price], handle);
+}
+
+// 将订单挂入买盘
+void OrderBook::addBid(const int64_t& price, const OrderHandle& handle){
+	linkTail(pool_, bids_[price], handle);
+}
+
+// 将订单从所在价格档位中摘除
+void OrderBook::unlink(const OrderHandle& handle){
+	auto& order=pool_.get(handle);
+	auto& level=*order.level;
+	if(order.prev==NIL_HANDLE){
+		level.head=order.next;
+	}else{
+		pool_.get(order.prev).next=order.next;
+	}
+	if(order.next==NIL_HANDLE){
+		level.tail=order.prev;
+	}else{
+		pool_.get(order.next).prev=order.prev;
+	}
+	order.level=nullptr;
+	order.prev=order.next=NIL_HANDLE;
+}
+
+// 将订单从订单簿中删除
+void OrderBook::removeOrder(const OrderHandle& handle){
+	auto& order=pool_.get(handle);
+	auto& level=*order.level;
+	unlink(handle);
+	// 档位为空时删除该档位
+	if(level.empty()){
+		if(order.side==SIDE_SELL){
+			asks_.erase(order.price);
+		}else{
+			bids_.erase(order.price);
+		}
+	}
+}
+#endif
@@ -0,0 +1,161 @@
+#ifndef ORDER_BOOK_H
+#define ORDER_BOOK_H
+
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <functional>
+#include <cmath>
+#include <atomic>
+#include <memory>
+#include "order_pool.h"
+#include "symbol_table.h"
+#include "book_snapshot.h"
+
+// 订单ID编码：高位为股票ID+1(保证ID不为0), 低位为该股票订单簿内的序号
+// 撤单时由订单ID直接得到所属订单簿, 无需全局订单表
+const int ORDER_SEQ_BITS=40;
+inline uint64_t makeOrderID(const SymbolID& symbol, const uint64_t& seq){
+	return ((uint64_t)symbol+1)<<ORDER_SEQ_BITS|seq;
+}
+// 订单ID所属的股票ID, ID非法时返回INVALID_SYMBOL
+inline SymbolID orderSymbol(const uint64_t& orderID){
+	uint64_t high=orderID>>ORDER_SEQ_BITS;
+	return high==0||high>INVALID_SYMBOL ? INVALID_SYMBOL: (SymbolID)(high-1);
+}
+
+// 价格档位：同一价格的订单按到达顺序链接成侵入式双向链表(FIFO), 保证时间优先
+// 链表指针存放在订单记录中, 档位本身只保存队首与队尾
+struct PriceLevel{
+	OrderHandle head=NIL_HANDLE;
+	OrderHandle tail=NIL_HANDLE;
+	bool empty() const {return head==NIL_HANDLE;}
+};
+
+// 按订单ID排序的挂单登记项
+struct OrderEntry{
+	uint64_t orderID;
+	OrderHandle handle;
+};
+
+// 卖盘：价格从低到高排列, begin()即为最优卖价
+typedef std::map<int64_t, PriceLevel> AskLevels;
+// 买盘：价格从高到低排列, begin()即为最优买价
+typedef std::map<int64_t, PriceLevel, std::greater<int64_t> > BidLevels;
+
+// 单只股票的订单簿：价格优先、时间优先
+class OrderBook{
+public:
+	// sessionOrders为各会话的挂单计数(可为nullptr), 登记和删除挂单时增减
+	OrderBook(const SymbolID& symbol, const std::string& stockID, const double& tickSize, const double& marketPrice,
+			std::atomic<uint32_t>* sessionOrders=nullptr):
+		symbol_(symbol), stockID_(stockID), tickSize_(tickSize), marketPrice_(std::llround(marketPrice/tickSize)), seq_(0), dead_(0), version_(0),
+		published_(0), sessionOrders_(sessionOrders){}
+	// 股票ID(整数)
+	SymbolID symbol() const {return symbol_;}
+	// 股票代码
+	const std::string& stockID() const {return stockID_;}
+	// 最小变动价位
+	double tickSize() const {return tickSize_;}
+	// 市价(以最小变动价位为单位)
+	int64_t marketPrice() const {return marketPrice_;}
+	// 价格换算: 整数价位 -> 显示价格
+	double toPrice(const int64_t& ticks) const {return ticks*tickSize_;}
+	// 价格换算: 显示价格 -> 整数价位, 价格不是最小变动价位的整数倍时返回false
+	bool toTicks(const double&, int64_t&) const;
+	// 卖盘
+	AskLevels& asks(){return asks_;}
+	// 买盘
+	BidLevels& bids(){return bids_;}
+	// 是否存在卖单/买单
+	bool hasAsk() const {return !asks_.empty();}
+	bool hasBid() const {return !bids_.empty();}
+	// 订单池
+	OrderPool& pool(){return pool_;}
+	const OrderPool& pool() const {return pool_;}
+	// 最优卖价/买价(调用前需确认对应盘口非空), O(1)
+	int64_t bestAsk() const {return asks_.begin()->first;}
+	int64_t bestBid() const {return bids_.begin()->first;}
+	// 将订单挂入卖盘/买盘对应价格档位的队尾
+	void addAsk(const int64_t&, const OrderHandle&);
+	void addBid(const int64_t&, const OrderHandle&);
+	// 将订单从所在价格档位中摘除, O(1), 档位为空时保留档位(撮合遍历档位时使用)
+	void unlink(const OrderHandle&);
+	// 将订单从订单簿中删除, 档位为空时删除该档位(撤单时使用)
+	void removeOrder(const OrderHandle&);
+	// 分配新的订单ID, 序号只在本订单簿内递增, 无需全局锁
+	uint64_t nextOrderID(){return makeOrderID(symbol_, ++seq_);}
+	// 最后分配的订单序号
+	uint64_t orderSeq() const {return seq_;}
+	// 恢复订单序号(从检查点或日志恢复时使用), 之后分配的订单ID不会与恢复的订单重复
+	void restoreSeq(const uint64_t& seq){if(seq>seq_) seq_=seq;}
+	// 登记挂单: 订单ID索引及所属客户的挂单链表
+	void indexOrder(const OrderHandle&);
+	// 查找挂单的句柄(存在返回true)
+	bool findOrder(const uint64_t&, OrderHandle&) const;
+	// 删除挂单的登记
+	void unindexOrder(const OrderHandle&);
+	// 客户在本订单簿中的最新一笔挂单, 没有时返回NIL_HANDLE, 之后沿clientNext按订单ID从大到小遍历
+	OrderHandle firstClientOrder(const uint64_t&) const;
+	// 按订单ID从小到大遍历不小于orderID的挂单, func返回false时停止, 定位为O(log n)
+	template<typename F>
+	void forEachOrderFrom(const uint64_t& orderID, F&& func){
+		auto it=std::lower_bound(byID_.begin(), byID_.end(), orderID,
+				[](const OrderEntry& entry, const uint64_t& id){return entry.orderID<id;});
+		for(; it!=byID_.end(); ++it){
+			auto& order=pool_.get(it->handle);
+			// 跳过已离开订单簿的条目(句柄已释放或已被其他订单复用)
+			if(order.orderID!=it->orderID||order.level==nullptr) continue;
+			if(!func(it->handle)) break;
+		}
+	}
+	// 挂单内容发生变化(挂入、离开、数量或价格修改)时调用, 标记所在快照页需要重建
+	void touchOrder(const OrderHandle&);
+	// 订单簿版本号, 每次修改挂单递增, 可在任意线程读取
+	uint64_t version() const {return version_.load(std::memory_order_acquire);}
+	// 当前发布的快照, 可在任意线程读取, 尚未发布时为nullptr
+	std::shared_ptr<const BookSnapshot> snapshot() const {return std::atomic_load(&snapshot_);}
+	// 上次发布快照之后有挂单发生变化, 可在任意线程读取
+	bool snapshotStale() const {return version()!=published_.load(std::memory_order_acquire);}
+	// 重建变化的页并发布新快照(在订单簿所属的线程中执行)
+	void publishSnapshot();
+	// 订单簿互斥量(仅加锁模式使用)：撮合与挂单在同一把锁内完成, 买卖两侧不会被观察到中间状态
+	// 分片模式下订单簿只由所属撮合线程访问, 无需加锁
+	std::mutex mutex;
+private:
+	SymbolID symbol_;
+	std::string stockID_;
+	double tickSize_;
+	int64_t marketPrice_;
+	AskLevels asks_;
+	BidLevels bids_;
+	// 本股票订单记录的存储, 与订单簿受同样的保护
+	OrderPool pool_;
+	// 订单序号
+	uint64_t seq_;
+	// 挂单索引<orderID, handle>
+	std::unordered_map<uint64_t, OrderHandle> orders_;
+	// 客户挂单链表的表头<clientID, handle>
+	std::unordered_map<uint64_t, OrderHandle> clients_;
+	// 按订单ID排序的挂单登记: 订单ID在订单簿内单调递增, 只在尾部追加
+	// 订单离开订单簿时不立即删除, 失效条目超过一半时整体压缩, 均摊O(1)
+	std::vector<OrderEntry> byID_;
+	// 失效条目数
+	size_t dead_;
+	// 版本号
+	std::atomic<uint64_t> version_;
+	// 自上次发布快照以来发生变化的页
+	std::vector<uint64_t> dirtyPages_;
+	std::vector<bool> dirty_;
+	// 已发布的快照的版本号
+	std::atomic<uint64_t> published_;
+	// 已发布的快照, 通过原子操作读写
+	std::shared_ptr<const BookSnapshot> snapshot_;
+	// 各会话的挂单计数, 由所有订单簿共享
+	std::atomic<uint32_t>* sessionOrders_;
+};
+
+#endif
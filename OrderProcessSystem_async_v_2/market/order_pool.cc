@@ -0,0 +1,26 @@
+#ifndef ORDER_POOL_CC
+#define ORDER_POOL_CC
+#include "order_pool.h"
+
+// 分配一条订单记录: 优先复用空闲记录, 否则从当前块中取, 块用尽时申请新块
+OrderHandle OrderPool::allocate(){
+	++size_;
+	if(!freeList_.empty()){
+		OrderHandle handle=freeList_.back();
+		freeList_.pop_back();
+		return handle;
+	}
+	if(next_==capacity_){
+		slabs_.emplace_back(new OrderRecord[SLAB_SIZE]);
+		clOrdIDs_.emplace_back(new uint64_t[SLAB_SIZE]);
+		capacity_+=SLAB_SIZE;
+	}
+	return next_++;
+}
+
+// 释放订单记录
+void OrderPool::release(const OrderHandle& handle){
+	freeList_.push_back(handle);
+	--size_;
+}
+#endif
@@ -0,0 +1,95 @@
+#ifndef ORDER_POOL_H
+#define ORDER_POOL_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+// 订单方向与类型(与NewOrderRequest中的枚举取值一致)
+enum OrderSide : uint8_t {SIDE_SELL=0, SIDE_BUY=1};
+enum OrderKind : uint8_t {KIND_LIMIT=0, KIND_MARKET=1};
+
+struct PriceLevel;
+
+// 会话ID：订单所属报单会话在会话表中的下标, 订单的应答按会话ID路由
+typedef uint16_t SessionID;
+const SessionID NO_SESSION=0xffff;
+// 最大会话数
+const uint32_t MAX_SESSIONS=4096;
+
+// 订单句柄：订单池中的下标
+typedef uint32_t OrderHandle;
+const OrderHandle NIL_HANDLE=0xffffffff;
+
+// 订单记录：定长POD, 不含任何堆上字符串, 存放在订单池中并通过句柄引用
+struct OrderRecord{
+	// 订单ID
+	uint64_t orderID;
+	// 客户ID
+	uint64_t clientID;
+	// 报单价格(以最小变动价位为单位的整数)
+	int64_t price;
+	// 订单所在的价格档位, 未挂单时为nullptr
+	PriceLevel* level;
+	// 报单时间(服务端接受订单的时间, 秒)
+	uint32_t time;
+	// 订单总量
+	uint32_t orderQty;
+	// 剩余待成交数量, 成交时原地修改
+	uint32_t leaveQty;
+	// 同一价格档位中的前一笔/后一笔订单(侵入式双向链表), 撤单时O(1)摘除
+	OrderHandle prev;
+	OrderHandle next;
+	// 同一客户在本订单簿中的前一笔/后一笔挂单, 批量撤单时按客户遍历
+	OrderHandle clientPrev;
+	OrderHandle clientNext;
+	// 买卖方向
+	OrderSide side;
+	// 订单类型
+	OrderKind kind;
+	// 报单会话
+	SessionID session;
+};
+static_assert(sizeof(OrderRecord)<=64, "OrderRecord should fit in one cache line");
+
+// 订单池：按块(slab)分配订单记录, 释放的记录进入空闲链表复用, 已分配的记录地址不会移动
+class OrderPool{
+public:
+	OrderPool():size_(0), next_(0), capacity_(0){}
+	// 分配一条订单记录
+	OrderHandle allocate();
+	// 释放订单记录
+	void release(const OrderHandle&);
+	// 通过句柄访问订单记录
+	OrderRecord& get(const OrderHandle& handle){
+		return slabs_[handle>>SLAB_BITS][handle&SLAB_MASK];
+	}
+	const OrderRecord& get(const OrderHandle& handle) const {
+		return slabs_[handle>>SLAB_BITS][handle&SLAB_MASK];
+	}
+	// 客户订单ID：撮合不使用, 存放在与订单记录平行的数组中, 订单记录保持在一个缓存行内
+	uint64_t& clOrdID(const OrderHandle& handle){
+		return clOrdIDs_[handle>>SLAB_BITS][handle&SLAB_MASK];
+	}
+	const uint64_t& clOrdID(const OrderHandle& handle) const {
+		return clOrdIDs_[handle>>SLAB_BITS][handle&SLAB_MASK];
+	}
+	// 使用中的订单记录数
+	size_t size() const {return size_;}
+private:
+	// 每块4096条记录
+	static const uint32_t SLAB_BITS=12;
+	static const uint32_t SLAB_SIZE=1u<<SLAB_BITS;
+	static const uint32_t SLAB_MASK=SLAB_SIZE-1;
+	std::vector<std::unique_ptr<OrderRecord[]> > slabs_;
+	// 与slabs_一一对应的客户订单ID块
+	std::vector<std::unique_ptr<uint64_t[]> > clOrdIDs_;
+	// 空闲句柄
+	std::vector<OrderHandle> freeList_;
+	size_t size_;
+	// 下一条从未使用过的记录
+	OrderHandle next_;
+	uint32_t capacity_;
+};
+
+#endif
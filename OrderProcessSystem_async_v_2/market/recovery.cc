@@ -0,0 +1,171 @@
+#ifndef RECOVERY_CC
+#define RECOVERY_CC
+#include "market.h"
+#include "checkpoint.h"
+#include <string.h>
+#include <chrono>
+
+// 检查点文件名: 日志文件名加后缀
+static const char* CHECKPOINT_SUFFIX=".ckpt";
+
+// 启用预写日志: 检查点 + 日志尾部回放
+bool TradingMarket::openJournal(const std::string& path, const uint32_t& commitMicros){
+	auto begin=std::chrono::steady_clock::now();
+	checkpointPath=path+CHECKPOINT_SUFFIX;
+	// 各股票检查点映像覆盖到的日志seq
+	std::vector<uint64_t> covered(MAX_STOCKS, 0);
+	uint64_t fromSeq=0, maxSeq=0, restored=0;
+	{
+		// 映射最新的检查点, 订单簿直接由映像批量重建, 不经过撮合
+		CheckpointFile file;
+		std::string error;
+		if(file.open(checkpointPath, error)){
+			const CheckpointBook* header;
+			const CheckpointOrder* orders;
+			std::string stockID;
+			while(file.next(header, stockID, orders)){
+				if(!symbols.restore(stockID, header->symbol)){
+					std::cerr<<"checkpoint: conflicting stock "<<stockID<<std::endl;
+					return false;
+				}
+				auto book=createOrderBook(header->symbol, stockID, header->tickSize);
+				restoreBook(*book, *header, orders);
+				covered[header->symbol]=header->journalSeq;
+				restored+=header->orders;
+			}
+			fromSeq=file.header().minSeq;
+			maxSeq=file.header().maxSeq;
+		}else if(!error.empty()){
+			std::cerr<<"checkpoint: cannot load "<<checkpointPath<<": "<<error<<std::endl;
+			return false;
+		}
+	}
+	// 只回放检查点之后的日志: 每条记录占用固定的64字节, 可以直接定位
+	JournalReader reader;
+	uint64_t replayed=0;
+	if(reader.open(path)){
+		if(fromSeq>0&&!reader.seek(fromSeq)){
+			std::cerr<<"journal: "<<path<<" starts after the checkpoint"<<std::endl;
+			return false;
+		}
+		JournalRecord record;
+		std::string stockID;
+		while(reader.next(record, stockID)){
+			if(!replayRecord(record, stockID, covered)){
+				std::cerr<<"journal: cannot replay record "<<record.seq<<std::endl;
+				return false;
+			}
+			replayed++;
+		}
+	}
+	// 不完整的事件被整个丢弃, 但其订单ID可能已随应答发出, 不再分配给新订单
+	if(reader.tornOrderID()!=0){
+		auto book=findOrderBook(orderSymbol(reader.tornOrderID()));
+		if(book!=nullptr) book->restoreSeq(reader.tornOrderID()&((1ull<<ORDER_SEQ_BITS)-1));
+	}
+	// 检查点只包含已落盘的记录, 日志短于检查点说明文件不匹配
+	if(reader.nextSeq()<maxSeq){
+		std::cerr<<"journal: "<<path<<" ends before the checkpoint"<<std::endl;
+		return false;
+	}
+	// 发布恢复后各订单簿的快照, 之后由撮合一方发布
+	bool restoredBooks=false;
+	for(SymbolID symbol=0;symbol<symbols.size();symbol++){
+		auto book=findOrderBook(symbol);
+		if(book==nullptr) continue;
+		book->publishSnapshot();
+		restoredBooks=true;
+	}
+	if(restoredBooks&&shards.empty()&&!snapshotThread.joinable()) startSnapshotThread();
+	std::unique_ptr<Journal> j(new Journal());
+	if(!j->open(path, commitMicros, reader.offset(), reader.nextSeq())) return false;
+	if(reader.nextSeq()==1) j->start();
+	journal=std::move(j);
+	auto millis=std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-begin).count();
+	std::cout<<"Recovered "<<restored<<" orders from checkpoint, replayed "<<replayed<<" journal records in "<<millis<<" ms"<<std::endl;
+	return true;
+}
+
+// 回放一条日志记录
+bool TradingMarket::replayRecord(const JournalRecord& record, const std::string& stockID, const std::vector<uint64_t>& covered){
+	if(record.type==JOURNAL_START) return true;
+	if(record.type==JOURNAL_BOOK){
+		SymbolID symbol=record.orderID;
+		if(symbol>=MAX_STOCKS) return false;
+		// 检查点中已有的订单簿
+		if(books[symbol].load(std::memory_order_relaxed)!=nullptr) return true;
+		double tickSize;
+		memcpy(&tickSize, &record.price, sizeof(tickSize));
+		if(!symbols.restore(stockID, symbol)) return false;
+		createOrderBook(symbol, stockID, tickSize);
+		return true;
+	}
+	auto symbol=orderSymbol(record.orderID);
+	auto book=findOrderBook(symbol);
+	if(book==nullptr) return false;
+	// 日志中出现过的订单ID都不能再分配给新订单
+	book->restoreSeq(record.orderID&((1ull<<ORDER_SEQ_BITS)-1));
+	// 已包含在检查点映像中的记录
+	if(record.seq<covered[symbol]) return true;
+	OrderHandle handle;
+	switch(record.type){
+	case JOURNAL_ACCEPT:{
+		if(record.leaveQty==0) return true;
+		// 撮合过的市价单剩余部分挂在市价上, 其余订单挂在报单价位上
+		int64_t price=record.flags&JOURNAL_AT_MARKET ? book->marketPrice(): record.price;
+		CheckpointOrder order{record.orderID, record.other, price, record.clOrdID,
+				record.time, record.qty, record.leaveQty, record.side, record.kind, 0};
+		book->indexOrder(restoreOrder(*book, order));
+		return true;
+	}
+	case JOURNAL_FILL:{
+		if(!book->findOrder(record.other, handle)) return false;
+		auto& order=book->pool().get(handle);
+		if(order.leaveQty<record.qty) return false;
+		order.leaveQty-=record.qty;
+		if(order.leaveQty>0){
+			book->touchOrder(handle);
+			return true;
+		}
+		break;
+	}
+	case JOURNAL_CANCEL:
+		if(!book->findOrder(record.orderID, handle)) return false;
+		break;
+	case JOURNAL_REPLACE:{
+		if(!book->findOrder(record.orderID, handle)) return false;
+		auto& order=book->pool().get(handle);
+		if(record.flags&JOURNAL_REQUEUE){
+			// 先按原价位摘除, 剩余部分挂到新档位的队尾
+			book->removeOrder(handle);
+			order.price=record.price;
+			order.kind=record.kind;
+			order.time=record.time;
+			order.orderQty=record.qty;
+			order.leaveQty=record.leaveQty;
+			if(order.leaveQty==0){
+				book->unindexOrder(handle);
+				book->pool().release(handle);
+				return true;
+			}else if(order.side==SIDE_SELL){
+				book->addAsk(order.price, handle);
+			}else{
+				book->addBid(order.price, handle);
+			}
+		}else{
+			order.orderQty=record.qty;
+			order.leaveQty=record.leaveQty;
+		}
+		book->touchOrder(handle);
+		return true;
+	}
+	default:
+		return false;
+	}
+	// 订单离开订单簿
+	book->unindexOrder(handle);
+	book->removeOrder(handle);
+	book->pool().release(handle);
+	return true;
+}
+#endif
@@ -0,0 +1,67 @@
+#ifndef SYMBOL_TABLE_CC
+#define SYMBOL_TABLE_CC
+#include "symbol_table.h"
+
+// 代码表编号生成器
+static std::atomic<uint64_t> nextTableID(1);
+
+SymbolTable::SymbolTable(const uint32_t& capacity):
+	tableID_(nextTableID++), capacity_(capacity), size_(0){}
+
+// 查找或分配股票ID
+SymbolID SymbolTable::intern(const std::string& stockID){
+	// 线程本地缓存: 股票ID一经分配不会改变, 命中时既不加锁也不访问共享的hash表
+	thread_local uint64_t cacheOwner=0;
+	thread_local std::unordered_map<std::string, SymbolID> cache;
+	if(cacheOwner!=tableID_){
+		cache.clear();
+		cacheOwner=tableID_;
+	}
+	auto it=cache.find(stockID);
+	if(it!=cache.end()) return it->second;
+
+	SymbolID symbol=INVALID_SYMBOL;
+	{
+		// 读锁
+		std::shared_lock<std::shared_mutex> r(mutex_);
+		auto found=ids_.find(stockID);
+		if(found!=ids_.end()) symbol=found->second;
+	}
+	if(symbol==INVALID_SYMBOL){
+		// 写锁
+		std::unique_lock<std::shared_mutex> w(mutex_);
+		auto found=ids_.find(stockID);
+		if(found!=ids_.end()){
+			symbol=found->second;
+		}else{
+			// 恢复的ID之间可能有空缺, 新ID总是排在最大的ID之后
+			symbol=size_.load(std::memory_order_relaxed);
+			if(symbol>=capacity_) return INVALID_SYMBOL;
+			ids_.insert(std::make_pair(stockID, symbol));
+			size_.store(symbol+1, std::memory_order_release);
+		}
+	}
+	cache.insert(std::make_pair(stockID, symbol));
+	return symbol;
+}
+
+// 恢复股票代码原来的ID
+bool SymbolTable::restore(const std::string& stockID, const SymbolID& symbol){
+	if(symbol>=capacity_) return false;
+	// 写锁
+	std::unique_lock<std::shared_mutex> w(mutex_);
+	auto found=ids_.find(stockID);
+	if(found!=ids_.end()) return found->second==symbol;
+	ids_.insert(std::make_pair(stockID, symbol));
+	if(symbol>=size_.load(std::memory_order_relaxed)) size_.store(symbol+1, std::memory_order_release);
+	return true;
+}
+
+// 查找股票ID
+SymbolID SymbolTable::find(const std::string& stockID){
+	// 读锁
+	std::shared_lock<std::shared_mutex> r(mutex_);
+	auto found=ids_.find(stockID);
+	return found==ids_.end() ? INVALID_SYMBOL: found->second;
+}
+#endif
@@ -0,0 +1,39 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <shared_mutex>
+
+// 股票ID：股票代码在股票代码表中的下标
+typedef uint32_t SymbolID;
+const SymbolID INVALID_SYMBOL=0xffffffff;
+
+// 股票代码表：将股票代码字符串映射为从0开始连续分配的整数ID, 分配后不再改变
+class SymbolTable{
+public:
+	explicit SymbolTable(const uint32_t& capacity);
+	// 查找或分配股票ID, 超出容量时返回INVALID_SYMBOL
+	SymbolID intern(const std::string&);
+	// 查找股票ID, 不存在时返回INVALID_SYMBOL(不分配)
+	SymbolID find(const std::string&);
+	// 恢复股票代码原来的ID(从检查点或日志恢复时使用), 之后新分配的ID都大于已恢复的ID
+	// 代码已有其他ID或ID超出容量时返回false
+	bool restore(const std::string&, const SymbolID&);
+	// 已分配的股票数量
+	uint32_t size() const {return size_.load(std::memory_order_acquire);}
+	// 最大股票数量
+	uint32_t capacity() const {return capacity_;}
+private:
+	// 代码表编号, 用于区分线程本地缓存属于哪个代码表
+	uint64_t tableID_;
+	uint32_t capacity_;
+	std::atomic<uint32_t> size_;
+	std::unordered_map<std::string, SymbolID> ids_;
+	std::shared_mutex mutex_;
+};
+
+#endif
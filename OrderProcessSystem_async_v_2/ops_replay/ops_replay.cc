@@ -0,0 +1,277 @@
+// 离线日志回放工具: 只链接撮合核心静态库ops_market(不依赖gRPC和protobuf), 把预写日志中记录的报单、撤单和改单按原顺序尽快交给TradingMarket
+// 统计吞吐量和每个事件的处理延迟, 可选地逐笔核对回放产生的成交与日志中记录的成交
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <unordered_map>
+#include "../market/market.h"
+#include "../market/journal.h"
+
+// 延迟直方图的桶数: 第i个桶统计[2^(i-1), 2^i)纳秒
+const int HISTOGRAM_BUCKETS=40;
+
+// 回放选项
+struct ReplayOptions{
+	// 撮合线程数, 0为加锁模式
+	uint32_t matchThreads=0;
+	// 核对成交
+	bool verify=false;
+	std::string journal;
+};
+
+// 从日志中读出的待回放内容
+struct ReplayInput{
+	// 按日志顺序排列的ACCEPT/CANCEL/REPLACE记录
+	std::vector<JournalRecord> events;
+	// ACCEPT记录对应的新订单请求, 与events中的ACCEPT记录依次对应
+	std::vector<NewOrder> orders;
+	// 各股票按日志顺序排列的成交记录, 每个事件撮合产生的成交紧跟在该事件之后
+	std::unordered_map<SymbolID, std::deque<JournalRecord> > fills;
+	uint64_t records=0;
+	uint64_t fillCount=0;
+};
+
+bool parseOptions(int argc, char** argv, ReplayOptions& options){
+	int opt;
+	while((opt=getopt(argc, argv, "m:v"))!=-1){
+		switch(opt){
+		case 'm':
+			options.matchThreads=atoi(optarg);
+			break;
+		case 'v':
+			options.verify=true;
+			break;
+		default:
+			return false;
+		}
+	}
+	if(optind!=argc-1) return false;
+	options.journal=argv[optind];
+	return true;
+}
+
+// 读出整个日志并预先生成请求, 计时只覆盖撮合本身
+bool loadJournal(const std::string& path, TradingMarket* market, ReplayInput& input){
+	JournalReader reader;
+	if(!reader.open(path)){
+		std::cerr<<"ops_replay: cannot open "<<path<<std::endl;
+		return false;
+	}
+	// 日志中的股票ID -> 股票代码
+	std::unordered_map<SymbolID, std::string> stocks;
+	JournalRecord record;
+	std::string stockID;
+	while(reader.next(record, stockID)){
+		input.records++;
+		switch(record.type){
+		case JOURNAL_BOOK:{
+			// 按日志中创建订单簿的顺序登记股票, 并恢复最小变动价位
+			double tickSize;
+			memcpy(&tickSize, &record.price, sizeof(tickSize));
+			stocks[record.orderID]=stockID;
+			market->setTickSize(stockID, tickSize);
+			break;
+		}
+		case JOURNAL_ACCEPT:{
+			auto stock=stocks.find(orderSymbol(record.orderID));
+			if(stock==stocks.end()){
+				std::cerr<<"ops_replay: record "<<record.seq<<" refers to an unknown stock"<<std::endl;
+				return false;
+			}
+			// 按原报单价位和订单类型重新报单, 市价单剩余部分挂到市价上的过程由撮合重现
+			NewOrder request;
+			request.clientID=record.other;
+			request.side=record.side;
+			request.kind=record.kind;
+			request.stockID=stock->second;
+			request.orderQty=record.qty;
+			request.priceTicks=record.price;
+			request.clOrdID=record.clOrdID;
+			input.orders.push_back(request);
+			input.events.push_back(record);
+			break;
+		}
+		case JOURNAL_CANCEL:
+		case JOURNAL_REPLACE:
+			input.events.push_back(record);
+			break;
+		case JOURNAL_FILL:
+			input.fills[orderSymbol(record.orderID)].push_back(record);
+			input.fillCount++;
+			break;
+		default:
+			break;
+		}
+	}
+	std::cout<<"Loaded "<<input.records<<" journal records: "<<input.events.size()<<" events, "
+		<<input.fillCount<<" fills"<<std::endl;
+	return true;
+}
+
+// 成交核对的统计
+struct FillCheck{
+	uint64_t matched=0;
+	uint64_t mismatched=0;
+	// 回放多出的成交
+	uint64_t extra=0;
+};
+
+// 只保留成交记录中与撮合结果有关的字段, seq、时间和校验和不参与比较
+static void normalizeFill(JournalRecord& record){
+	record.seq=0;
+	record.time=0;
+	record.checksum=0;
+}
+
+// 核对一个事件的成交: 应答中的成交成对出现(主动方在前, 被动方在后)
+static void checkFills(const std::vector<std::pair<SessionID, Execution> >& reports, std::deque<JournalRecord>& expected,
+		const std::unordered_map<uint64_t, uint64_t>& ids, FillCheck& check){
+	for(size_t i=0;i+1<reports.size();i++){
+		auto& aggressor=reports[i].second;
+		if(aggressor.stat!=EXEC_FILL) continue;
+		auto& passive=reports[++i].second;
+		JournalRecord replayed;
+		memset(&replayed, 0, sizeof(replayed));
+		replayed.type=JOURNAL_FILL;
+		replayed.orderID=aggressor.orderID;
+		replayed.other=passive.orderID;
+		replayed.price=aggressor.fillPriceTicks;
+		replayed.qty=aggressor.fillQty;
+		if(expected.empty()){
+			check.extra++;
+			continue;
+		}
+		// 日志中的订单ID换算为回放中分配的订单ID
+		auto recorded=expected.front();
+		expected.pop_front();
+		normalizeFill(recorded);
+		auto aggressorID=ids.find(recorded.orderID), passiveID=ids.find(recorded.other);
+		if(aggressorID!=ids.end()) recorded.orderID=aggressorID->second;
+		if(passiveID!=ids.end()) recorded.other=passiveID->second;
+		if(memcmp(&recorded, &replayed, sizeof(JournalRecord))==0){
+			check.matched++;
+		}else{
+			if(check.mismatched==0){
+				std::cerr<<"ops_replay: first mismatched fill: recorded "<<recorded.orderID<<"/"<<recorded.other<<" "
+					<<recorded.qty<<"@"<<recorded.price<<", replayed "<<replayed.orderID<<"/"<<replayed.other<<" "
+					<<replayed.qty<<"@"<<replayed.price<<std::endl;
+			}
+			check.mismatched++;
+		}
+	}
+}
+
+// 输出延迟分布: 分位数取自全部样本, 直方图按2的幂分桶
+static void printLatency(std::vector<uint32_t>& latencies){
+	if(latencies.empty()) return;
+	uint64_t buckets[HISTOGRAM_BUCKETS]={0};
+	for(auto ns:latencies){
+		int bucket=ns==0 ? 0: 32-__builtin_clz(ns);
+		buckets[std::min(bucket, HISTOGRAM_BUCKETS-1)]++;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile=[&latencies](const double& p){
+		return latencies[std::min(latencies.size()-1, (size_t)(p*latencies.size()))];
+	};
+	std::cout<<"Latency (ns): p50 "<<percentile(0.5)<<", p90 "<<percentile(0.9)<<", p99 "<<percentile(0.99)
+		<<", p99.9 "<<percentile(0.999)<<", max "<<latencies.back()<<std::endl;
+	for(int i=0;i<HISTOGRAM_BUCKETS;i++){
+		if(buckets[i]==0) continue;
+		uint64_t lower=i==0 ? 0: 1ull<<(i-1);
+		std::cout<<"  ["<<std::setw(10)<<lower<<", "<<std::setw(10)<<(1ull<<i)<<") "<<std::setw(10)<<buckets[i]<<" "
+			<<std::fixed<<std::setprecision(3)<<std::setw(7)<<100.0*buckets[i]/latencies.size()<<"%"<<std::endl;
+	}
+}
+
+// 按日志顺序回放全部事件, 核对成交时全部一致返回true
+bool replay(TradingMarket* market, ReplayInput& input, const bool& verify){
+	// 日志中的订单ID -> 回放中分配的订单ID
+	std::unordered_map<uint64_t, uint64_t> ids;
+	ids.reserve(input.orders.size());
+	std::vector<uint32_t> latencies;
+	latencies.reserve(input.events.size());
+	std::vector<std::pair<SessionID, Execution> > reports;
+	Execution report;
+	SessionID session;
+	AmendOrder amend;
+	FillCheck check;
+	uint64_t rejected=0, skipped=0;
+	size_t nextOrder=0;
+	auto begin=std::chrono::steady_clock::now();
+	for(auto& event:input.events){
+		reports.clear();
+		std::chrono::steady_clock::time_point start;
+		if(event.type==JOURNAL_ACCEPT){
+			uint64_t orderID=0;
+			start=std::chrono::steady_clock::now();
+			market->processNewOrder(input.orders[nextOrder++], NO_SESSION, reports, orderID);
+			ids[event.orderID]=orderID;
+		}else{
+			auto id=ids.find(event.orderID);
+			if(id==ids.end()){
+				// 订单在日志之外(例如日志被截断过), 无法回放
+				skipped++;
+				continue;
+			}
+			if(event.type==JOURNAL_CANCEL){
+				start=std::chrono::steady_clock::now();
+				market->processCancelOrder(id->second, report, session);
+				if(report.error!=nullptr) rejected++;
+			}else{
+				// 失去时间优先的限价改单带上新价位, 其余只改数量
+				amend.orderID=id->second;
+				amend.orderQty=event.qty;
+				amend.priceTicks=(event.flags&JOURNAL_REQUEUE)&&event.kind==KIND_LIMIT ? event.price: 0;
+				start=std::chrono::steady_clock::now();
+				market->processAmendOrder(amend, reports);
+			}
+		}
+		auto end=std::chrono::steady_clock::now();
+		latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count());
+		for(auto& r:reports){
+			if(r.second.error!=nullptr) rejected++;
+		}
+		if(verify){
+			checkFills(reports, input.fills[orderSymbol(event.orderID)], ids, check);
+		}
+	}
+	auto micros=std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-begin).count();
+	uint64_t processed=latencies.size();
+	std::cout<<"Replayed "<<processed<<" events in "<<micros/1000.0<<" ms, "
+		<<(uint64_t)(micros>0 ? processed*1e6/micros: 0)<<" msgs/sec";
+	if(rejected>0||skipped>0) std::cout<<" ("<<rejected<<" rejected, "<<skipped<<" skipped)";
+	std::cout<<std::endl;
+	printLatency(latencies);
+	if(verify){
+		// 日志中剩余未对上的成交
+		uint64_t missing=0;
+		for(auto& fills:input.fills) missing+=fills.second.size();
+		std::cout<<"Fills: "<<check.matched<<" identical, "<<check.mismatched<<" different, "
+			<<missing<<" missing, "<<check.extra<<" extra"<<std::endl;
+		return check.mismatched==0&&missing==0&&check.extra==0;
+	}
+	return true;
+}
+
+int main(int argc, char** argv){
+	ReplayOptions options;
+	if(!parseOptions(argc, argv, options)){
+		std::cout<<"usage: "<<argv[0]<<" [-m matchThreads] [-v] journalFile"<<std::endl;
+		return 1;
+	}
+	auto market=TradingMarket::getInstance();
+	ReplayInput input;
+	if(!loadJournal(options.journal, market, input)) return 1;
+	if(options.matchThreads>0){
+		market->startMatchThreads(options.matchThreads);
+	}
+	return replay(market, input, options.verify) ? 0: 2;
+}
@@ -1,6 +1,6 @@
 #include "market.h"
 // 根据新订单请求做出应答消息
-void TradingMarket::processNewOrder(const NewOrderRequest& request, ServerReaderWriter<ExecutionReport, NewOrderRequest>* stream){
+void TradingMarket::processNewOrder(const NewOrderRequest& request, const std::shared_ptr<ReportQueue>& stream){
 	std::string errorMessage="";
 	// 初始化应答
 	ExecutionReport report;
@@ -10,18 +10,23 @@ void TradingMarket::processNewOrder(const NewOrderRequest& request, ServerReader
 		// 非法订单输出报错信息
 		report.set_time(getTime());
 		report.set_errormessage(errorMessage);
-		stream->Write(report);
+		stream->push(report);
 		return;
 	}
 	// 创建订单
 	auto orderID=createOrder(request);
 	// 存储订单对应的stream
-	orderID_stream[orderID]=stream;
+	{
+		std::lock_guard<std::mutex> lg(stream_mutex);
+		orderID_stream[orderID]=stream;
+	}
 	// 输出订单创建成功的消息
 	report.set_stat(ExecutionReport::ORDER_ACCEPT);
 	report.set_orderid(orderID);
 	report.set_time(getTime());
-	stream->Write(report);
+	stream->push(report);
+	// 持股票锁期间只撮合并记录成交应答, 解锁后再分发
+	std::vector<std::pair<uint64_t, ExecutionReport> > events;
 	// 获取订单对应的股票ID
 	auto stockID=request.stockid();
 	// Sell
@@ -30,7 +35,7 @@ void TradingMarket::processNewOrder(const NewOrderRequest& request, ServerReader
 		std::lock_guard<std::mutex> lg(*stock_mutex[stockID].second);
 		// 存在该股票且订单数不为0, 搜索买订单
 		if(sell_buy_containers.count(stockID)&&sell_buy_containers[stockID].buy.size()>0){
-			sellOrders(orderID, stockID);
+			sellOrders(orderID, stockID, events);
 		}
 	// Buy
 	}else{
@@ -38,9 +43,10 @@ void TradingMarket::processNewOrder(const NewOrderRequest& request, ServerReader
 		std::lock_guard<std::mutex> lg(*stock_mutex[stockID].first);
 		// 存在该股票且订单数不为0, 搜索卖订单
 		if(sell_buy_containers.count(stockID)&&sell_buy_containers[stockID].sell.size()>0){
-			buyOrders(orderID, stockID);	
+			buyOrders(orderID, stockID, events);	
 		}
 	}
+	dispatch(events);
 	// 分开的缺点：order不能及时插入容器中
 	// Sell
 	if(request.direction()==NewOrderRequest::SELL){
@@ -84,8 +90,6 @@ void TradingMarket::processCancelOrder(const CancelOrderRequest& request, Execut
 			sell_buy_containers[stockID].sell.erase(orderID);
 		// 从订单容器中删除订单
 		deleteOrder(orderID);
-		// 删除订单及其对应的流
-		orderID_stream.erase(orderID);
 	}else{
 		// 对stockID的买订单集合加锁,作用域结束自动解锁
 		std::lock_guard<std::mutex> lg(*stock_mutex[stockID].second);
@@ -94,7 +98,10 @@ void TradingMarket::processCancelOrder(const CancelOrderRequest& request, Execut
 			sell_buy_containers[stockID].buy.erase(orderID);
 		// 从订单容器中删除订单
 		deleteOrder(orderID);
-		// 删除订单及其对应的流
+	}
+	// 删除订单对应的流
+	{
+		std::lock_guard<std::mutex> lg(stream_mutex);
 		orderID_stream.erase(orderID);
 	}
 	report.set_stat(ExecutionReport::CANCELED);
@@ -106,7 +113,8 @@ void TradingMarket::processCancelOrder(const CancelOrderRequest& request, Execut
 }
 
 // 卖订单操作
-void TradingMarket::sellOrders(const uint64_t& orderID, const std::string& stockID){
+void TradingMarket::sellOrders(const uint64_t& orderID, const std::string& stockID,
+		std::vector<std::pair<uint64_t, ExecutionReport> >& events){
 	// 获取卖订单
 	NewOrderRequest& sellOrder=orders[orderID];
 	// 记录成交的数量
@@ -153,12 +161,9 @@ void TradingMarket::sellOrders(const uint64_t& orderID, const std::string& stock
 		// 从数据库中修改buy订单的库存量
 		auto num=buyOrder.orderqty();
 		buyOrder.set_orderqty(num-tradNum);
-		// 获取buy和sell order的stream
-		auto& sellOrder_stream=orderID_stream[orderID];
-		auto& buyOrder_stream=orderID_stream[buyOrderID];
-		// 发出report
-		sellOrder_stream->Write(report);
-		buyOrder_stream->Write(report_);
+		// 记录report, 解锁后发出
+		events.push_back(std::make_pair(orderID, report));
+		events.push_back(std::make_pair(buyOrderID, report_));
 		// 判断订单的数量是否大于0
 		if(buyOrder.orderqty()==0){
 			orderSet.erase(it++);
@@ -177,7 +182,8 @@ void TradingMarket::sellOrders(const uint64_t& orderID, const std::string& stock
 }
 
 // 买订单操作
-void TradingMarket::buyOrders(const uint64_t& orderID, const std::string& stockID){
+void TradingMarket::buyOrders(const uint64_t& orderID, const std::string& stockID,
+		std::vector<std::pair<uint64_t, ExecutionReport> >& events){
 	// 获取买订单
 	NewOrderRequest& buyOrder=orders[orderID];
 	// 记录成交的数量
@@ -224,12 +230,9 @@ void TradingMarket::buyOrders(const uint64_t& orderID, const std::string& stockI
 		// 从数据库中修改订单的库存量
 		auto num=sellOrder.orderqty();
 		sellOrder.set_orderqty(num-tradNum);
-		// 获取buy和sell order的stream
-		auto& buyOrder_stream=orderID_stream[orderID];
-		auto& sellOrder_stream=orderID_stream[sellOrderID];
-		// 发送report
-		buyOrder_stream->Write(report);
-		sellOrder_stream->Write(report_);
+		// 记录report, 解锁后发送
+		events.push_back(std::make_pair(orderID, report));
+		events.push_back(std::make_pair(sellOrderID, report_));
 		// 判断订单的数量是否大于0
 		if(sellOrder.orderqty()==0){
 			orderSet.erase(it++);
@@ -247,6 +250,18 @@ void TradingMarket::buyOrders(const uint64_t& orderID, const std::string& stockI
 	}
 }
 
+// 将应答放入订单所属报单流的应答队列, 只入队不写流, 不会被慢客户端阻塞
+void TradingMarket::dispatch(const std::vector<std::pair<uint64_t, ExecutionReport> >& events){
+	if(events.empty()) return;
+	std::lock_guard<std::mutex> lg(stream_mutex);
+	for(auto& event:events){
+		auto it=orderID_stream.find(event.first);
+		if(it!=orderID_stream.end()){
+			it->second->push(event.second);
+		}
+	}
+}
+
 // 创建订单
 uint64_t TradingMarket::createOrder(const NewOrderRequest& request){
 	// 加锁，作用域结束自动解锁
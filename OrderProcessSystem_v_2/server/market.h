@@ -9,7 +9,10 @@
 #include <time.h>
 #include <mutex>
 #include <utility>
+#include <memory>
+#include <vector>
 #include "../helper/helper.h"
+#include "report_queue.h"
 
 #include <grpc/grpc.h>
 #include <grpcpp/server.h>
@@ -47,8 +50,8 @@ public:
 		if(m_instance==NULL) m_instance=new TradingMarket();
 		return m_instance;
 	}
-	// 根据新订单请求做出应答消息
-	void processNewOrder(const NewOrderRequest&, ServerReaderWriter<ExecutionReport, NewOrderRequest>*);
+	// 根据新订单请求做出应答消息, 应答放入订单所属报单流的应答队列
+	void processNewOrder(const NewOrderRequest&, const std::shared_ptr<ReportQueue>&);
 	// 根据撤销订单请求做出应答消息
 	void processCancelOrder(const CancelOrderRequest&, ExecutionReport&);
 private:
@@ -71,10 +74,12 @@ private:
 	void alterOrder(const uint64_t&, const NewOrderRequest&);
 	// 删除订单
 	void deleteOrder(const uint64_t&);
-	// 卖订单
-	void sellOrders(const uint64_t&, const std::string&);
-	// 买订单
-	void buyOrders(const uint64_t&, const std::string&);
+	// 卖订单, 成交应答追加到events<orderID, report>
+	void sellOrders(const uint64_t&, const std::string&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
+	// 买订单, 成交应答追加到events<orderID, report>
+	void buyOrders(const uint64_t&, const std::string&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
+	// 将应答放入订单所属报单流的应答队列(不持有股票锁时调用)
+	void dispatch(const std::vector<std::pair<uint64_t, ExecutionReport> >&);
 	// 将订单加入至待售卖容器
 	void addOrderToSell(const std::string&, const uint64_t&);
 	// 将订单加入至待购买容器
@@ -82,10 +87,10 @@ private:
 	// 市场价
 	double market; 
 	// 访问互斥锁
-	std::mutex orderID_mutex, cancel_mutex;
+	std::mutex orderID_mutex, cancel_mutex, stream_mutex;
 	// <stockID, pair<first: sell_mutex, second: buy_mutex> >
 	std::unordered_map<std::string, std::pair<std::mutex*, std::mutex*> > stock_mutex; 
-	// 订单ID对应的stream
-	std::unordered_map<uint64_t, ServerReaderWriter<ExecutionReport, NewOrderRequest>*> orderID_stream;
+	// 订单ID对应的报单流应答队列, 由stream_mutex保护
+	std::unordered_map<uint64_t, std::shared_ptr<ReportQueue> > orderID_stream;
 };
 #endif
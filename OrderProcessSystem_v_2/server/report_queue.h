@@ -0,0 +1,50 @@
+#ifndef REPORT_QUEUE_H
+#define REPORT_QUEUE_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "../proto/OrderProcessSystem.grpc.pb.h"
+
+using OPS::ExecutionReport;
+
+// 报单流的应答队列：撮合线程只入队, 由报单流所属的RPC处理线程取出并写入流
+// 撮合不会因为某个客户端写得慢而阻塞
+class ReportQueue{
+public:
+	ReportQueue():closed_(false){}
+	// 入队, 队列已关闭(流已结束)时丢弃并返回false
+	bool push(const ExecutionReport& report){
+		{
+			std::lock_guard<std::mutex> lg(mutex_);
+			if(closed_) return false;
+			reports_.push_back(report);
+		}
+		cv_.notify_one();
+		return true;
+	}
+	// 取出全部应答, 队列为空时等待; 队列已关闭且为空时返回false
+	bool popAll(std::vector<ExecutionReport>& reports){
+		std::unique_lock<std::mutex> lk(mutex_);
+		cv_.wait(lk, [this](){return closed_||!reports_.empty();});
+		if(reports_.empty()) return false;
+		reports.swap(reports_);
+		reports_.clear();
+		return true;
+	}
+	// 关闭队列, 之后的入队全部丢弃, 已入队的应答仍可取出
+	void close(){
+		{
+			std::lock_guard<std::mutex> lg(mutex_);
+			closed_=true;
+		}
+		cv_.notify_all();
+	}
+private:
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::vector<ExecutionReport> reports_;
+	bool closed_;
+};
+
+#endif
@@ -6,6 +6,8 @@
 #include <time.h>
 #include <mutex>
 #include <utility>
+#include <thread>
+#include <memory>
 #include "market.h"
 #include "../helper/helper.h"
 
@@ -44,14 +46,32 @@ public:
 	~OrderServiceImpl(){
 	}
 
-	// 报单
+	// 报单：读线程读入请求并撮合, 应答只进入本流的应答队列; 本线程从队列中取出应答写入流
+	// 写流不在任何股票锁内进行, 慢客户端只会阻塞自己的处理线程
 	Status PushNewOrder(ServerContext* context, ServerReaderWriter<ExecutionReport, NewOrderRequest>* stream) override{
-		NewOrderRequest request;
-		// 流：读入请求
-		while(stream->Read(&request)){
-			// 处理订单请求
-			tradingMarket->processNewOrder(request, stream);
+		std::shared_ptr<ReportQueue> queue=std::make_shared<ReportQueue>();
+		std::thread reader([this, stream, queue](){
+			NewOrderRequest request;
+			// 流：读入请求
+			while(stream->Read(&request)){
+				// 处理订单请求
+				tradingMarket->processNewOrder(request, queue);
+			}
+			// 客户端断开, 关闭应答队列
+			queue->close();
+		});
+		std::vector<ExecutionReport> reports;
+		while(queue->popAll(reports)){
+			for(auto& report:reports){
+				if(!stream->Write(report)){
+					// 流已断开, 之后的应答全部丢弃
+					queue->close();
+					break;
+				}
+			}
+			reports.clear();
 		}
+		reader.join();
 		return Status::OK;
 	}
 	// 撤单